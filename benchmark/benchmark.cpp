@@ -0,0 +1,1820 @@
+/*
+ * CPU-side benchmark of the ambient occlusion preprocessing.
+ * It runs without an OpenGL context, so it can be used on machines without a GPU.
+ *
+ * usage: AmbientOcclusionBenchmark [parse|parse-threads|mesh-cache|tree-cache|next-links|tree-build|element-cache|charts|element-build|quantized|wide|leaf-size|max-distance|normal-cone|
+ *        dynamic-cpu|high-quality-cpu|robust-bake|packets]
+ *        [iterations]
+ *
+ */
+
+#include "occlusion_tree.h"
+#include "surface_element.h"
+#include "dynamic_occlusion_solver.h"
+#include "high_quality_occlusion_solver.h"
+#include "robust_occlusion_baker.h"
+#include "occlusion_kernel.h"
+
+#include <regex>
+#include <new>
+#include <cstdlib>
+
+// the heap usage of the whole process, counted by replacing the global allocation functions below.
+class HeapCounter final
+{
+public:
+   HeapCounter() = delete;
+
+   static void add(size_t size)
+   {
+      const size_t current = CurrentBytes += size;
+      size_t peak = PeakBytes;
+      while (current > peak && !PeakBytes.compare_exchange_weak( peak, current )) {}
+   }
+   static void remove(size_t size) { CurrentBytes -= size; }
+   static void resetPeak() { PeakBytes = CurrentBytes.load(); }
+   [[nodiscard]] static size_t getCurrentBytes() { return CurrentBytes; }
+   [[nodiscard]] static size_t getPeakBytes() { return PeakBytes; }
+
+private:
+   inline static std::atomic<size_t> CurrentBytes{ 0 };
+   inline static std::atomic<size_t> PeakBytes{ 0 };
+};
+
+// every block is prefixed with its size, which keeps the default alignment of new.
+inline constexpr size_t HeapBlockHeaderSize = alignof( std::max_align_t );
+
+void* operator new(size_t size)
+{
+   auto* block = static_cast<char*>(std::malloc( size + HeapBlockHeaderSize ));
+   if (block == nullptr) throw std::bad_alloc();
+   *reinterpret_cast<size_t*>(block) = size;
+   HeapCounter::add( size );
+   return block + HeapBlockHeaderSize;
+}
+
+void operator delete(void* ptr) noexcept
+{
+   if (ptr == nullptr) return;
+   char* block = static_cast<char*>(ptr) - HeapBlockHeaderSize;
+   HeapCounter::remove( *reinterpret_cast<size_t*>(block) );
+   std::free( block );
+}
+
+void* operator new[](size_t size) { return operator new( size ); }
+void operator delete[](void* ptr) noexcept { operator delete( ptr ); }
+void operator delete(void* ptr, size_t) noexcept { operator delete( ptr ); }
+void operator delete[](void* ptr, size_t) noexcept { operator delete( ptr ); }
+
+class Stopwatch final
+{
+public:
+   Stopwatch() : Start( std::chrono::steady_clock::now() ) {}
+
+   [[nodiscard]] double getElapsedSeconds() const
+   {
+      return std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+   }
+
+private:
+   std::chrono::steady_clock::time_point Start;
+};
+
+struct Sample
+{
+   std::string Name;
+   std::string FilePath;
+
+   Sample(std::string name, std::string file_path) : Name( std::move( name ) ), FilePath( std::move( file_path ) ) {}
+};
+
+std::vector<Sample> getSamples()
+{
+   const std::string sample_directory_path = std::string(CMAKE_SOURCE_DIR) + "/samples";
+   return {
+      { "buddha", sample_directory_path + "/Buddha/buddha.obj" },
+      { "bunny", sample_directory_path + "/Bunny/bunny.obj" },
+      { "tiger", sample_directory_path + "/Tiger/tiger.obj" },
+      { "zebra", sample_directory_path + "/Zebra/zebra.obj" }
+   };
+}
+
+template<typename Function>
+double getBestSeconds(int iterations, Function&& function)
+{
+   double best = std::numeric_limits<double>::max();
+   for (int i = 0; i < iterations; ++i) {
+      Stopwatch stopwatch;
+      function();
+      best = std::min( best, stopwatch.getElapsedSeconds() );
+   }
+   return best;
+}
+
+// the stream and regex based parser which was used before ObjectFileReader. it is kept only as a reference.
+bool readObjectFileWithStream(ObjectMesh& mesh, const std::string& file_path)
+{
+   std::ifstream file(file_path);
+   if (!file.is_open()) return false;
+
+   mesh.clear();
+   while (!file.eof()) {
+      std::string word;
+      file >> word;
+
+      if (word == "v") {
+         glm::vec3 vertex;
+         file >> vertex.x >> vertex.y >> vertex.z;
+         mesh.Vertices.emplace_back( vertex );
+      }
+      else if (word == "vt") {
+         glm::vec2 uv;
+         file >> uv.x >> uv.y;
+         mesh.Textures.emplace_back( uv );
+      }
+      else if (word == "vn") {
+         glm::vec3 normal;
+         file >> normal.x >> normal.y >> normal.z;
+         mesh.Normals.emplace_back( normal );
+      }
+      else if (word == "f") {
+         std::string face;
+         const std::regex delimiter("[/]");
+         for (int i = 0; i < 3; ++i) {
+            file >> face;
+            const std::sregex_token_iterator it(face.begin(), face.end(), delimiter, -1);
+            const std::vector<std::string> vtn(it, std::sregex_token_iterator());
+            mesh.VertexIndices.emplace_back( std::stoi( vtn[0] ) - 1 );
+            mesh.TextureIndices.emplace_back( std::stoi( vtn[1] ) - 1 );
+            mesh.NormalIndices.emplace_back( std::stoi( vtn[2] ) - 1 );
+         }
+      }
+      else std::getline( file, word );
+   }
+   return true;
+}
+
+bool isSameMesh(const ObjectMesh& a, const ObjectMesh& b)
+{
+   return a.Vertices == b.Vertices && a.Textures == b.Textures && a.Normals == b.Normals &&
+      a.VertexIndices == b.VertexIndices && a.TextureIndices == b.TextureIndices;
+}
+
+void benchmarkParse(int iterations)
+{
+   std::cout << "[parse] best of " << iterations << " runs\n";
+   std::cout << std::left << std::setw( 10 ) << "sample" << std::right
+      << std::setw( 10 ) << "MB" << std::setw( 10 ) << "faces"
+      << std::setw( 14 ) << "stream MB/s" << std::setw( 14 ) << "mapped MB/s"
+      << std::setw( 10 ) << "speedup" << std::setw( 8 ) << "equal" << "\n";
+   for (const auto& sample : getSamples()) {
+      const double megabytes = static_cast<double>(std::filesystem::file_size( sample.FilePath )) / (1024.0 * 1024.0);
+      ObjectMesh stream_mesh, mapped_mesh;
+      const double stream_seconds = getBestSeconds(
+         iterations, [&]() { readObjectFileWithStream( stream_mesh, sample.FilePath ); }
+      );
+      const double mapped_seconds = getBestSeconds(
+         iterations, [&]() { static_cast<void>(ObjectFileReader::read( mapped_mesh, sample.FilePath )); }
+      );
+      std::cout << std::left << std::setw( 10 ) << sample.Name << std::right << std::fixed << std::setprecision( 2 )
+         << std::setw( 10 ) << megabytes << std::setw( 10 ) << mapped_mesh.VertexIndices.size() / 3
+         << std::setw( 14 ) << megabytes / stream_seconds << std::setw( 14 ) << megabytes / mapped_seconds
+         << std::setw( 9 ) << stream_seconds / mapped_seconds << "x"
+         << std::setw( 8 ) << (isSameMesh( stream_mesh, mapped_mesh ) ? "yes" : "no") << "\n";
+   }
+}
+
+// a side x side grid of vertices with texture coordinates, written as .obj text. it has 2 * (side - 1)^2 triangles.
+std::string getSyntheticObjectFile(int side)
+{
+   std::string text;
+   std::array<char, 64> buffer{};
+   const auto append_number = [&text, &buffer](auto value)
+   {
+      const auto result = std::to_chars( buffer.data(), buffer.data() + buffer.size(), value );
+      text.append( buffer.data(), result.ptr );
+   };
+   const float step = 1.0f / static_cast<float>(side - 1);
+   for (int y = 0; y < side; ++y) {
+      for (int x = 0; x < side; ++x) {
+         const float u = static_cast<float>(x) * step;
+         const float v = static_cast<float>(y) * step;
+         text += "v ";
+         append_number( u );
+         text += ' ';
+         append_number( v );
+         text += ' ';
+         append_number( 0.1f * std::sin( 20.0f * u ) * std::cos( 20.0f * v ) );
+         text += "\nvt ";
+         append_number( u );
+         text += ' ';
+         append_number( v );
+         text += '\n';
+      }
+   }
+   const auto append_corner = [&text, &append_number](int index)
+   {
+      text += ' ';
+      append_number( index );
+      text += '/';
+      append_number( index );
+   };
+   for (int y = 0; y < side - 1; ++y) {
+      for (int x = 0; x < side - 1; ++x) {
+         const int i = y * side + x + 1;
+         text += 'f';
+         append_corner( i );
+         append_corner( i + 1 );
+         append_corner( i + side );
+         text += "\nf";
+         append_corner( i + 1 );
+         append_corner( i + side + 1 );
+         append_corner( i + side );
+         text += '\n';
+      }
+   }
+   return text;
+}
+
+void benchmarkParseThreads(int iterations)
+{
+   const int max_thread_num = std::max( static_cast<int>(std::thread::hardware_concurrency()), 1 );
+   std::vector<int> thread_nums;
+   for (int n = 1; n < max_thread_num; n *= 2) thread_nums.emplace_back( n );
+   thread_nums.emplace_back( max_thread_num );
+
+   std::cout << "[parse-threads] best of " << iterations << " runs, " << max_thread_num << " hardware threads\n";
+   std::cout << std::left << std::setw( 10 ) << "sample" << std::right
+      << std::setw( 10 ) << "MB" << std::setw( 10 ) << "faces" << std::setw( 10 ) << "threads"
+      << std::setw( 10 ) << "MB/s" << std::setw( 10 ) << "scaling" << std::setw( 8 ) << "equal" << "\n";
+
+   const auto measure = [&](const std::string& name, const char* begin, const char* end)
+   {
+      const double megabytes = static_cast<double>(end - begin) / (1024.0 * 1024.0);
+      ObjectMesh serial_mesh;
+      double serial_seconds = 0.0;
+      for (const auto& thread_num : thread_nums) {
+         ObjectMesh mesh;
+         const double seconds = getBestSeconds(
+            iterations, [&]() { ObjectFileReader::parse( mesh, begin, end, thread_num ); }
+         );
+         if (thread_num == 1) {
+            serial_mesh = mesh;
+            serial_seconds = seconds;
+         }
+         std::cout << std::left << std::setw( 10 ) << name << std::right << std::fixed << std::setprecision( 2 )
+            << std::setw( 10 ) << megabytes << std::setw( 10 ) << mesh.VertexIndices.size() / 3
+            << std::setw( 10 ) << thread_num << std::setw( 10 ) << megabytes / seconds
+            << std::setw( 9 ) << serial_seconds / seconds << "x"
+            << std::setw( 8 ) << (isSameMesh( serial_mesh, mesh ) ? "yes" : "no") << "\n";
+      }
+   };
+   for (const auto& sample : getSamples()) {
+      std::ifstream file(sample.FilePath, std::ios::binary);
+      const std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+      measure( sample.Name, text.data(), text.data() + text.size() );
+   }
+   const std::string synthetic = getSyntheticObjectFile( 1000 );
+   measure( "synthetic", synthetic.data(), synthetic.data() + synthetic.size() );
+}
+
+void benchmarkMeshCache(int iterations)
+{
+   std::cout << "[mesh-cache] best of " << iterations << " runs\n";
+   std::cout << "  touched: the first load after the .obj file gets a new modification time with the same contents\n";
+   std::cout << "  rewarm: the loads after that one, which take the warm path again\n";
+   std::cout << std::left << std::setw( 10 ) << "sample" << std::right
+      << std::setw( 12 ) << "cold ms" << std::setw( 12 ) << "warm ms" << std::setw( 10 ) << "speedup"
+      << std::setw( 12 ) << "touched ms" << std::setw( 12 ) << "rewarm ms"
+      << std::setw( 12 ) << "cache MB" << std::setw( 8 ) << "equal" << "\n";
+   for (const auto& sample : getSamples()) {
+      const std::string cache_file_path = MeshCache::getCacheFilePath( sample.FilePath, ".aomesh" );
+      ObjectMesh cold_mesh, warm_mesh, touched_mesh;
+      const double cold_seconds = getBestSeconds(
+         iterations, [&]()
+         {
+            std::filesystem::remove( cache_file_path );
+            static_cast<void>(MeshCache::read( cold_mesh, sample.FilePath ));
+         }
+      );
+      const double warm_seconds = getBestSeconds(
+         iterations, [&]() { static_cast<void>(MeshCache::read( warm_mesh, sample.FilePath )); }
+      );
+
+      // as after a checkout. the original time is restored at the end, which rewrites the cache once more.
+      const auto source_time = std::filesystem::last_write_time( sample.FilePath );
+      std::filesystem::last_write_time( sample.FilePath, source_time + std::chrono::seconds( 1 ) );
+      const double touched_seconds =
+         getBestSeconds( 1, [&]() { static_cast<void>(MeshCache::read( touched_mesh, sample.FilePath )); } );
+      const double rewarm_seconds = getBestSeconds(
+         iterations, [&]() { static_cast<void>(MeshCache::read( touched_mesh, sample.FilePath )); }
+      );
+      std::filesystem::last_write_time( sample.FilePath, source_time );
+      static_cast<void>(MeshCache::read( touched_mesh, sample.FilePath ));
+
+      const double megabytes =
+         static_cast<double>(std::filesystem::file_size( cache_file_path )) / (1024.0 * 1024.0);
+      const bool equal =
+         isSameMesh( cold_mesh, warm_mesh ) && cold_mesh.VertexNormals == warm_mesh.VertexNormals &&
+         isSameMesh( cold_mesh, touched_mesh ) && cold_mesh.VertexNormals == touched_mesh.VertexNormals;
+      std::cout << std::left << std::setw( 10 ) << sample.Name << std::right << std::fixed << std::setprecision( 2 )
+         << std::setw( 12 ) << cold_seconds * 1e+3 << std::setw( 12 ) << warm_seconds * 1e+3
+         << std::setw( 9 ) << cold_seconds / warm_seconds << "x" << std::setw( 12 ) << touched_seconds * 1e+3
+         << std::setw( 12 ) << rewarm_seconds * 1e+3 << std::setw( 12 ) << megabytes
+         << std::setw( 8 ) << (equal ? "yes" : "no") << "\n";
+   }
+}
+
+bool isSameDisks(const std::vector<OcclusionTree::Disk>& a, const std::vector<OcclusionTree::Disk>& b)
+{
+   // the padding of the disks is not initialized, so they are compared member by member.
+   // the members are compared bitwise, because degenerate triangles have NaN normals.
+   const auto same = [](const auto& x, const auto& y) { return std::memcmp( &x, &y, sizeof( x ) ) == 0; };
+   return std::equal(
+      a.begin(), a.end(), b.begin(), b.end(),
+      [&same](const OcclusionTree::Disk& p, const OcclusionTree::Disk& q)
+      {
+         return p.ParentIndex == q.ParentIndex && p.NextIndex == q.NextIndex &&
+            p.LeftChildIndex == q.LeftChildIndex && p.RightChildIndex == q.RightChildIndex &&
+            same( p.AreaOverPi, q.AreaOverPi ) && same( p.Accessibility, q.Accessibility ) &&
+            p.FaceBegin == q.FaceBegin && p.FaceCount == q.FaceCount &&
+            same( p.Centroid, q.Centroid ) && same( p.Radius, q.Radius ) && same( p.Normal, q.Normal ) &&
+            same( p.ConeSine, q.ConeSine ) && same( p.BentNormal, q.BentNormal );
+      }
+   );
+}
+
+void benchmarkTreeCache(int iterations)
+{
+   std::cout << "[tree-cache] best of " << iterations << " runs, including the cached mesh load\n";
+   std::cout << std::left << std::setw( 10 ) << "sample" << std::right
+      << std::setw( 10 ) << "disks" << std::setw( 12 ) << "build ms" << std::setw( 12 ) << "cached ms"
+      << std::setw( 10 ) << "speedup" << std::setw( 8 ) << "equal" << "\n";
+   for (const auto& sample : getSamples()) {
+      std::unique_ptr<OcclusionTree> built, cached;
+      const double build_seconds = getBestSeconds(
+         iterations, [&]()
+         {
+            built = std::make_unique<OcclusionTree>();
+            static_cast<void>(built->buildOcclusionTree( sample.FilePath, false ));
+         }
+      );
+      static_cast<void>(OcclusionTree().buildOcclusionTree( sample.FilePath, true ));
+      const double cached_seconds = getBestSeconds(
+         iterations, [&]()
+         {
+            cached = std::make_unique<OcclusionTree>();
+            static_cast<void>(cached->buildOcclusionTree( sample.FilePath, true ));
+         }
+      );
+      const bool equal =
+         built->getRootIndex() == cached->getRootIndex() && isSameDisks( built->getDisks(), cached->getDisks() ) &&
+         built->getLeafFaces() == cached->getLeafFaces();
+      std::cout << std::left << std::setw( 10 ) << sample.Name << std::right << std::fixed << std::setprecision( 2 )
+         << std::setw( 10 ) << built->getDiskSize() << std::setw( 12 ) << build_seconds * 1e+3
+         << std::setw( 12 ) << cached_seconds * 1e+3 << std::setw( 9 ) << build_seconds / cached_seconds << "x"
+         << std::setw( 8 ) << (equal ? "yes" : "no") << "\n";
+   }
+}
+
+// the children of a disk from its child and parent links only, without NextIndex. a binary disk has its left and right
+// children, and the children of a collapsed disk are the disks whose parent it is, in the order of their indices, which
+// is the order of the siblings in both the BUILD_ORDER and the DEPTH_FIRST layouts.
+std::vector<std::vector<int>> getChildren(const OcclusionTree& tree)
+{
+   const auto& disks = tree.getDisks();
+   std::vector<std::vector<int>> children(disks.size());
+   if (tree.getBranchingFactor() == 2) {
+      for (size_t i = 0; i < disks.size(); ++i) {
+         if (disks[i].LeftChildIndex != OcclusionTree::NullIndex) {
+            children[i] = { disks[i].LeftChildIndex, disks[i].RightChildIndex };
+         }
+      }
+   }
+   else {
+      for (int i = 0; i < static_cast<int>(disks.size()); ++i) {
+         if (disks[i].ParentIndex != OcclusionTree::NullIndex) children[disks[i].ParentIndex].emplace_back( i );
+      }
+   }
+   return children;
+}
+
+// the links are checked against the traversal before the next links, which visited the children from the root, and
+// climbed toward the root for the next disk of every disk as getNextIndex() did.
+// sequence: the traversal which descends everywhere by the next links visits the disks as the traversal by children.
+// hot/cold: the same for the emitters of the HOT_COLD layout, which descend to their ChildIndex.
+// next: the next link of every disk is its next sibling, or the next disk of its parent for the last sibling.
+// groups: the children of every disk are next to each other, from LeftChildIndex to RightChildIndex, which all the
+// layouts but the binary BUILD_ORDER promise.
+bool checkNextLinks(
+   bool& same_sequence,
+   bool& same_hot_cold,
+   bool& same_next,
+   bool& same_groups,
+   const OcclusionTree& tree
+)
+{
+   const auto& disks = tree.getDisks();
+   const auto disk_size = static_cast<int>(disks.size());
+   const std::vector<std::vector<int>> children = getChildren( tree );
+
+   // the walks stop after more disks than the tree has, so that broken links which make a cycle fail the check.
+   std::vector<int> reference, sequence;
+   std::vector<int> stack{ tree.getRootIndex() };
+   while (!stack.empty() && static_cast<int>(reference.size()) <= disk_size) {
+      const int index = stack.back();
+      stack.pop_back();
+      reference.emplace_back( index );
+      stack.insert( stack.end(), children[index].rbegin(), children[index].rend() );
+   }
+   for (int i = tree.getRootIndex(); i != OcclusionTree::NullIndex && static_cast<int>(sequence.size()) <= disk_size;) {
+      sequence.emplace_back( i );
+      i = disks[i].LeftChildIndex != OcclusionTree::NullIndex ? disks[i].LeftChildIndex : disks[i].NextIndex;
+   }
+   same_sequence = static_cast<int>(reference.size()) == disk_size && sequence == reference;
+
+   same_hot_cold = true;
+   if (tree.getLayout() == OcclusionTree::DISK_LAYOUT::HOT_COLD) {
+      std::vector<OcclusionTree::EmitterForShader> emitters;
+      std::vector<OcclusionTree::ReceiverForShader> receivers;
+      tree.getHotColdDisks( emitters, receivers );
+      std::vector<int> hot_cold_sequence;
+      for (int i = 0; i >= 0 && static_cast<int>(hot_cold_sequence.size()) <= disk_size;) {
+         hot_cold_sequence.emplace_back( i );
+         i = emitters[i].ChildIndex >= 0 ? emitters[i].ChildIndex : emitters[i].NextIndex;
+      }
+      same_hot_cold = hot_cold_sequence == reference;
+   }
+
+   same_groups = true;
+   if (tree.getLayout() != OcclusionTree::DISK_LAYOUT::BUILD_ORDER || tree.getBranchingFactor() > 2) {
+      for (int d = 0; d < disk_size && same_groups; ++d) {
+         const auto& group = children[d];
+         for (size_t c = 0; c < group.size() && same_groups; ++c) {
+            same_groups = group[c] == disks[d].LeftChildIndex + static_cast<int>(c);
+         }
+         same_groups = same_groups && (group.empty() || group.back() == disks[d].RightChildIndex);
+      }
+   }
+
+   same_next = true;
+   for (int d = 0; d < disk_size && same_next; ++d) {
+      // a disk which is not a child of its parent, or a cycle of parents, fails the check.
+      bool linked = false;
+      int next = OcclusionTree::NullIndex;
+      for (int i = d, depth = 0; depth <= disk_size; ++depth) {
+         if (i == tree.getRootIndex()) {
+            linked = true;
+            break;
+         }
+         const int parent = disks[i].ParentIndex;
+         if (parent == OcclusionTree::NullIndex) break;
+
+         const auto& siblings = children[parent];
+         const auto position = std::find( siblings.begin(), siblings.end(), i );
+         if (position == siblings.end()) break;
+         if (position + 1 != siblings.end()) {
+            linked = true;
+            next = *(position + 1);
+            break;
+         }
+         i = parent;
+      }
+      same_next = linked && disks[d].NextIndex == next;
+   }
+   return same_sequence && same_hot_cold && same_next && same_groups;
+}
+
+bool benchmarkNextLinks()
+{
+   std::cout << "[next-links] the next links of every build method, layout, and branching factor\n";
+   std::cout << "  sequence: the traversal by the next links visits the disks as the traversal by the children\n";
+   std::cout << "  hot/cold: the same for the emitters of the HOT_COLD layout\n";
+   std::cout << "  next: the next link of every disk is the one which getNextIndex() climbed to from the disk\n";
+   std::cout << "  groups: the children of every disk are next to each other, except in the binary build order\n";
+   std::cout << std::left << std::setw( 10 ) << "sample" << std::setw( 14 ) << "method" << std::setw( 14 ) << "layout"
+      << std::right << std::setw( 8 ) << "width" << std::setw( 10 ) << "disks" << std::setw( 10 ) << "sequence"
+      << std::setw( 10 ) << "hot/cold" << std::setw( 8 ) << "next" << std::setw( 8 ) << "groups" << "\n";
+   using BUILD_METHOD = OcclusionTree::BUILD_METHOD;
+   using DISK_LAYOUT = OcclusionTree::DISK_LAYOUT;
+   const std::array<std::pair<BUILD_METHOD, const char*>, 2> methods{
+      std::make_pair( BUILD_METHOD::MEDIAN_SPLIT, "median-split" ),
+      std::make_pair( BUILD_METHOD::MORTON_CODE, "morton-code" )
+   };
+   const std::array<std::pair<DISK_LAYOUT, const char*>, 3> layouts{
+      std::make_pair( DISK_LAYOUT::BUILD_ORDER, "build-order" ),
+      std::make_pair( DISK_LAYOUT::DEPTH_FIRST, "depth-first" ),
+      std::make_pair( DISK_LAYOUT::HOT_COLD, "hot-cold" )
+   };
+   bool all_same = true;
+   for (const auto& sample : getSamples()) {
+      for (const auto& method : methods) {
+         for (const auto& layout : layouts) {
+            for (const int width : { 2, 4 }) {
+               OcclusionTree tree;
+               if (!tree.buildOcclusionTree( sample.FilePath, false, method.first, layout.first, width ) ||
+                   tree.getDiskSize() == 0) continue;
+
+               bool same_sequence, same_hot_cold, same_next, same_groups;
+               all_same &= checkNextLinks( same_sequence, same_hot_cold, same_next, same_groups, tree );
+               const bool grouped = layout.first != DISK_LAYOUT::BUILD_ORDER || width > 2;
+               std::cout << std::left << std::setw( 10 ) << sample.Name << std::setw( 14 ) << method.second
+                  << std::setw( 14 ) << layout.second << std::right << std::setw( 8 ) << width
+                  << std::setw( 10 ) << tree.getDiskSize() << std::setw( 10 ) << (same_sequence ? "yes" : "no")
+                  << std::setw( 10 ) << (layout.first == DISK_LAYOUT::HOT_COLD ? (same_hot_cold ? "yes" : "no") : "-")
+                  << std::setw( 8 ) << (same_next ? "yes" : "no")
+                  << std::setw( 8 ) << (grouped ? (same_groups ? "yes" : "no") : "-") << "\n";
+            }
+         }
+      }
+   }
+   return all_same;
+}
+
+bool isSameElements(
+   const std::vector<SurfaceElement::ElementForShader>& a,
+   const std::vector<SurfaceElement::ElementForShader>& b
+)
+{
+   const auto same = [](const auto& x, const auto& y) { return std::memcmp( &x, &y, sizeof( x ) ) == 0; };
+   return std::equal(
+      a.begin(), a.end(), b.begin(), b.end(),
+      [&same](const SurfaceElement::ElementForShader& p, const SurfaceElement::ElementForShader& q)
+      {
+         return p.NextIndex == q.NextIndex && p.ChildIndex == q.ChildIndex && same( p.AreaOverPi, q.AreaOverPi ) &&
+            same( p.Position, q.Position ) && same( p.Normal, q.Normal ) && p.RadiusAndCone == q.RadiusAndCone;
+      }
+   );
+}
+
+void benchmarkElementCache(int iterations)
+{
+   std::cout << "[element-cache] best of " << iterations << " runs, including the cached mesh load\n";
+   std::cout << std::left << std::setw( 10 ) << "sample" << std::right
+      << std::setw( 10 ) << "elements" << std::setw( 12 ) << "build ms" << std::setw( 12 ) << "cached ms"
+      << std::setw( 10 ) << "speedup" << std::setw( 8 ) << "equal" << "\n";
+   for (const auto& sample : getSamples()) {
+      std::unique_ptr<SurfaceElement> built, cached;
+      bool has_elements = true;
+      const double build_seconds = getBestSeconds(
+         iterations, [&]()
+         {
+            built = std::make_unique<SurfaceElement>();
+            has_elements = built->buildSurfaceElements( sample.FilePath, false );
+         }
+      );
+      if (!has_elements) continue;
+
+      static_cast<void>(SurfaceElement().buildSurfaceElements( sample.FilePath, true ));
+      const double cached_seconds = getBestSeconds(
+         iterations, [&]()
+         {
+            cached = std::make_unique<SurfaceElement>();
+            static_cast<void>(cached->buildSurfaceElements( sample.FilePath, true ));
+         }
+      );
+      const bool equal =
+         built->getVertexBufferSize() == cached->getVertexBufferSize() &&
+         built->getIndexNum() == cached->getIndexNum() &&
+         isSameElements( built->getElements(), cached->getElements() );
+      std::cout << std::left << std::setw( 10 ) << sample.Name << std::right << std::fixed << std::setprecision( 2 )
+         << std::setw( 10 ) << built->getElements().size() << std::setw( 12 ) << build_seconds * 1e+3
+         << std::setw( 12 ) << cached_seconds * 1e+3 << std::setw( 9 ) << build_seconds / cached_seconds << "x"
+         << std::setw( 8 ) << (equal ? "yes" : "no") << "\n";
+   }
+}
+
+// the chart labelling which SurfaceElement used before, kept as the reference of the current one.
+int getChartLabelsWithSweeps(
+   std::vector<int>& ids,
+   std::vector<glm::vec2>& separators,
+   size_t vertex_num,
+   const std::vector<glm::vec2>& textures,
+   const std::vector<GLuint>& vertex_indices,
+   const std::vector<GLuint>& texture_indices
+)
+{
+   ids.assign( vertex_num, 0 );
+   separators.assign( vertex_num, glm::vec2(0.0f) );
+   int id = 0;
+   const auto size = static_cast<int>(vertex_indices.size());
+   std::vector<int> visit(textures.size(), 0);
+   for (int i = 0; i < static_cast<int>(textures.size()); ++i) {
+      if (visit[i] != 0) continue;
+
+      id++;
+      visit[i] = id;
+      bool is_changed = true;
+      while (is_changed) {
+         is_changed = false;
+         for (int j = 0; j < size; j += 3) {
+            if (visit[texture_indices[j]] != id &&
+                visit[texture_indices[j + 1]] != id &&
+                visit[texture_indices[j + 2]] != id) continue;
+
+            for (int k = 0; k < 3; ++k) {
+               if (visit[texture_indices[j + k]] == 0 || ids[vertex_indices[j + k]] == 0) {
+                  visit[texture_indices[j + k]] = id;
+                  ids[vertex_indices[j + k]] = id;
+                  separators[vertex_indices[j + k]] = textures[texture_indices[j + k]];
+                  is_changed = true;
+               }
+            }
+         }
+      }
+   }
+   return id;
+}
+
+void benchmarkCharts(int iterations)
+{
+   std::cout << "[charts] best of " << iterations << " runs\n";
+   std::cout << std::left << std::setw( 10 ) << "sample" << std::right
+      << std::setw( 10 ) << "charts" << std::setw( 12 ) << "sweeps ms" << std::setw( 12 ) << "queue ms"
+      << std::setw( 10 ) << "speedup" << std::setw( 8 ) << "equal" << "\n";
+   for (const auto& sample : getSamples()) {
+      ObjectMesh mesh;
+      if (!MeshCache::read( mesh, sample.FilePath ) || !mesh.hasTextures()) continue;
+
+      int sweep_charts = 0, queue_charts = 0;
+      std::vector<int> sweep_ids, queue_ids;
+      std::vector<glm::vec2> sweep_separators, queue_separators;
+      const double sweep_seconds = getBestSeconds(
+         iterations, [&]()
+         {
+            sweep_charts = getChartLabelsWithSweeps(
+               sweep_ids, sweep_separators, mesh.Vertices.size(), mesh.Textures, mesh.VertexIndices,
+               mesh.TextureIndices
+            );
+         }
+      );
+      const double queue_seconds = getBestSeconds(
+         iterations, [&]()
+         {
+            queue_charts = SurfaceElement::getChartLabels(
+               queue_ids, queue_separators, mesh.Vertices.size(), mesh.Textures, mesh.VertexIndices,
+               mesh.TextureIndices
+            );
+         }
+      );
+      const bool equal =
+         sweep_charts == queue_charts && sweep_ids == queue_ids && sweep_separators == queue_separators;
+      std::cout << std::left << std::setw( 10 ) << sample.Name << std::right << std::fixed << std::setprecision( 2 )
+         << std::setw( 10 ) << queue_charts << std::setw( 12 ) << sweep_seconds * 1e+3
+         << std::setw( 12 ) << queue_seconds * 1e+3 << std::setw( 9 ) << sweep_seconds / queue_seconds << "x"
+         << std::setw( 8 ) << (equal ? "yes" : "no") << "\n";
+   }
+}
+
+void benchmarkElementBuild(int iterations)
+{
+   std::cout << "[element-build] best of " << iterations << " runs without the .aoelem cache\n";
+   std::cout << std::left << std::setw( 10 ) << "sample" << std::right
+      << std::setw( 10 ) << "elements" << std::setw( 12 ) << "build ms" << std::setw( 14 ) << "peak heap MB" << "\n";
+   const auto measure = [iterations](const std::string& name, const std::string& file_path)
+   {
+      static_cast<void>(SurfaceElement().buildSurfaceElements( file_path, false ));
+
+      // the peak is measured from the heap usage before the build, and the mesh is loaded from the .aomesh cache.
+      std::unique_ptr<SurfaceElement> built;
+      bool has_elements = true;
+      size_t peak_bytes = 0;
+      const double build_seconds = getBestSeconds(
+         iterations, [&]()
+         {
+            built.reset();
+            const size_t base_bytes = HeapCounter::getCurrentBytes();
+            HeapCounter::resetPeak();
+            built = std::make_unique<SurfaceElement>();
+            has_elements = built->buildSurfaceElements( file_path, false );
+            peak_bytes = HeapCounter::getPeakBytes() - base_bytes;
+         }
+      );
+      if (!has_elements) return;
+
+      std::cout << std::left << std::setw( 10 ) << name << std::right << std::fixed << std::setprecision( 2 )
+         << std::setw( 10 ) << built->getElements().size() << std::setw( 12 ) << build_seconds * 1e+3
+         << std::setw( 14 ) << static_cast<double>(peak_bytes) / (1024.0 * 1024.0) << "\n";
+   };
+   for (const auto& sample : getSamples()) measure( sample.Name, sample.FilePath );
+
+   // a single chart of 1M vertices.
+   const std::filesystem::path synthetic_file_path =
+      std::filesystem::temp_directory_path() / "ambient_occlusion_synthetic.obj";
+   {
+      std::ofstream file(synthetic_file_path, std::ios::binary | std::ios::trunc);
+      file << getSyntheticObjectFile( 1000 );
+   }
+   measure( "synthetic", synthetic_file_path.string() );
+   std::error_code error;
+   std::filesystem::remove( synthetic_file_path, error );
+   std::filesystem::remove( MeshCache::getCacheFilePath( synthetic_file_path.string(), ".aomesh" ), error );
+}
+
+// the accessibility of a receiver after the first phase of shaders/high-quality/ambient_occlusion.comp, and the number
+// of the disks which are visited to get it. leaf_face_num counts the faces of the leaf disks which face the receiver,
+// whose form factors the robust occlusion of the scene pass evaluates. with brute_force, every leaf disk is an emitter.
+// without normal_cones, the subtrees are not culled by their normal cones.
+float getFirstPhaseAccessibility(
+   int& visited_num,
+   int& leaf_face_num,
+   const OcclusionTree& tree,
+   const glm::vec3& receiver_position,
+   const glm::vec3& receiver_normal,
+   bool brute_force,
+   bool normal_cones = true
+)
+{
+   const auto& disks = tree.getDisks();
+   const auto disk_size = static_cast<int>(disks.size());
+   const float proximity_tolerance = tree.getProximityTolerance();
+   const float max_occlusion_distance = tree.getMaxOcclusionDistance();
+   float total_shadow = 0.0f;
+   visited_num = 0;
+   leaf_face_num = 0;
+   for (int emitter = brute_force ? 0 : tree.getRootIndex(); emitter >= 0 && emitter < disk_size;) {
+      const OcclusionTree::Disk& e = disks[emitter];
+      visited_num++;
+      glm::vec3 v = e.Centroid - receiver_position;
+      const float squared_distance = glm::dot( v, v ) + 1e-16f;
+      const float reach = max_occlusion_distance + e.Radius;
+      if (squared_distance > reach * reach) {
+         emitter = brute_force ? emitter + 1 : e.NextIndex;
+         continue;
+      }
+      if (brute_force) {
+         if (e.LeftChildIndex >= 0) {
+            emitter++;
+            continue;
+         }
+      }
+      else if (e.LeftChildIndex >= 0 && squared_distance < e.AreaOverPi * proximity_tolerance) {
+         const bool culled =
+            normal_cones && OcclusionKernel::isCulledByNormalCone(
+               v, squared_distance, receiver_normal, e.Normal, e.Radius, e.ConeSine
+            );
+         emitter = culled ? e.NextIndex : e.LeftChildIndex;
+         continue;
+      }
+      v /= std::sqrt( squared_distance );
+      const float shadow =
+         OcclusionKernel::getDiskShadow( v, squared_distance, receiver_normal, e.Normal, e.AreaOverPi );
+      total_shadow += shadow;
+      if (e.LeftChildIndex < 0 && glm::dot( e.Normal, -v ) >= 0.0f) leaf_face_num += e.FaceCount;
+      emitter = brute_force ? emitter + 1 : e.NextIndex;
+   }
+   return std::clamp( 1.0f - total_shadow, 0.0f, 1.0f );
+}
+
+// the accessibility of the disk receiver after the first phase.
+float getFirstPhaseAccessibility(
+   int& visited_num,
+   const OcclusionTree& tree,
+   int receiver,
+   bool brute_force,
+   bool normal_cones = true
+)
+{
+   int leaf_face_num = 0;
+   const OcclusionTree::Disk& r = tree.getDisks()[receiver];
+   return getFirstPhaseAccessibility(
+      visited_num, leaf_face_num, tree, r.Centroid, r.Normal, brute_force, normal_cones
+   );
+}
+
+// getFirstPhaseAccessibility with the buffers of the HOT_COLD layout, where an emitter without a child is a leaf.
+float getFirstPhaseAccessibility(
+   int& visited_num,
+   const std::vector<OcclusionTree::EmitterForShader>& emitters,
+   float proximity_tolerance,
+   float max_occlusion_distance,
+   int root,
+   int receiver,
+   bool normal_cones = true
+)
+{
+   const OcclusionTree::EmitterForShader& r = emitters[receiver];
+   const glm::vec3 receiver_normal = Quantizer::getNormalFromOctahedral( r.Normal );
+   float total_shadow = 0.0f;
+   visited_num = 0;
+   for (int emitter = root; emitter >= 0;) {
+      const OcclusionTree::EmitterForShader& e = emitters[emitter];
+      visited_num++;
+      glm::vec3 v = e.Centroid - r.Centroid;
+      const float squared_distance = glm::dot( v, v ) + 1e-16f;
+      float radius, cone_sine;
+      Quantizer::getRadiusAndConeFromPacked( radius, cone_sine, e.RadiusAndCone );
+      const float reach = max_occlusion_distance + radius;
+      if (squared_distance > reach * reach) {
+         emitter = e.NextIndex;
+         continue;
+      }
+      const glm::vec3 emitter_normal = Quantizer::getNormalFromOctahedral( e.Normal );
+      if (e.ChildIndex >= 0 && squared_distance < e.AreaOverPi * proximity_tolerance) {
+         const bool culled =
+            normal_cones && OcclusionKernel::isCulledByNormalCone(
+               v, squared_distance, receiver_normal, emitter_normal, radius, cone_sine
+            );
+         emitter = culled ? e.NextIndex : e.ChildIndex;
+         continue;
+      }
+      v /= std::sqrt( squared_distance );
+      const float shadow =
+         OcclusionKernel::getDiskShadow( v, squared_distance, receiver_normal, emitter_normal, e.AreaOverPi );
+      total_shadow += shadow;
+      emitter = e.NextIndex;
+   }
+   return std::clamp( 1.0f - total_shadow, 0.0f, 1.0f );
+}
+
+void benchmarkTreeBuild(int iterations)
+{
+   std::cout << "[tree-build] best of " << iterations << " runs without the .aotree cache, on "
+      << ThreadPool().getThreadNum() << " threads\n";
+   std::cout << "  traverse: first phase of the high quality pass on the CPU for the receivers of all the faces\n";
+   std::cout << "  visited: disks visited per receiver in the first phase of the high quality pass\n";
+   std::cout << "  bytes/step: buffer bytes which the shaders fetch per visited disk, after the first phase\n";
+   std::cout << "  error: mean difference of the accessibility from the one with all the triangles as emitters\n";
+   std::cout << std::left << std::setw( 10 ) << "sample" << std::setw( 18 ) << "method" << std::right
+      << std::setw( 10 ) << "disks" << std::setw( 12 ) << "build ms" << std::setw( 14 ) << "traverse ms"
+      << std::setw( 10 ) << "visited" << std::setw( 12 ) << "bytes/step" << std::setw( 10 ) << "error" << "\n";
+   constexpr int receiver_num = 256;
+   struct Method
+   {
+      OcclusionTree::BUILD_METHOD BuildMethod;
+      OcclusionTree::DISK_LAYOUT Layout;
+      const char* Name;
+   };
+   using BUILD_METHOD = OcclusionTree::BUILD_METHOD;
+   using DISK_LAYOUT = OcclusionTree::DISK_LAYOUT;
+   const std::array<Method, 6> methods{
+      Method{ BUILD_METHOD::MEDIAN_SPLIT, DISK_LAYOUT::BUILD_ORDER, "median-split" },
+      Method{ BUILD_METHOD::MEDIAN_SPLIT, DISK_LAYOUT::DEPTH_FIRST, "median-split-dfs" },
+      Method{ BUILD_METHOD::MEDIAN_SPLIT, DISK_LAYOUT::HOT_COLD, "median-split-hot" },
+      Method{ BUILD_METHOD::MORTON_CODE, DISK_LAYOUT::BUILD_ORDER, "morton-code" },
+      Method{ BUILD_METHOD::MORTON_CODE, DISK_LAYOUT::DEPTH_FIRST, "morton-code-dfs" },
+      Method{ BUILD_METHOD::MORTON_CODE, DISK_LAYOUT::HOT_COLD, "morton-code-hot" }
+   };
+   for (const auto& sample : getSamples()) {
+      std::vector<float> references;
+      for (const auto& method : methods) {
+         std::unique_ptr<OcclusionTree> built;
+         bool has_disks = true;
+         const double build_seconds = getBestSeconds(
+            iterations, [&]()
+            {
+               built = std::make_unique<OcclusionTree>();
+               has_disks = built->buildOcclusionTree( sample.FilePath, false, method.BuildMethod, method.Layout );
+            }
+         );
+         if (!has_disks || built->getDiskSize() == 0) break;
+
+         // the emitters of the HOT_COLD layout are fetched with the accessibility of the receiver of the same index.
+         const bool hot_cold = method.Layout == DISK_LAYOUT::HOT_COLD;
+         const size_t step_bytes = hot_cold ?
+            sizeof( OcclusionTree::EmitterForShader ) + sizeof( float ) : sizeof( OcclusionTree::Disk );
+         std::vector<OcclusionTree::EmitterForShader> emitters;
+         std::vector<OcclusionTree::ReceiverForShader> receivers;
+         if (hot_cold) built->getHotColdDisks( emitters, receivers );
+
+         const int face_num = built->getFaceNum();
+         const float proximity_tolerance = built->getProximityTolerance();
+         int visited_num = 0;
+         const double traverse_seconds = getBestSeconds(
+            iterations, [&]()
+            {
+               for (int f = 0; f < face_num; ++f) {
+                  const int receiver = built->getLeafIndex( f );
+                  static_cast<void>(
+                     hot_cold ?
+                        getFirstPhaseAccessibility(
+                           visited_num, emitters, proximity_tolerance, built->getMaxOcclusionDistance(),
+                           built->getRootIndex(), receiver
+                        ) :
+                        getFirstPhaseAccessibility( visited_num, *built, receiver, false )
+                  );
+               }
+            }
+         );
+
+         const int step = std::max( face_num / receiver_num, 1 );
+         const bool has_references = !references.empty();
+         int64_t total_visited_num = 0;
+         double total_error = 0.0;
+         int count = 0;
+         for (int f = 0; f < face_num; f += step, ++count) {
+            const int receiver = built->getLeafIndex( f );
+            if (!has_references) {
+               references.emplace_back( getFirstPhaseAccessibility( visited_num, *built, receiver, true ) );
+            }
+            const float accessibility = getFirstPhaseAccessibility( visited_num, *built, receiver, false );
+            total_visited_num += visited_num;
+            total_error += std::abs( accessibility - references[count] );
+         }
+         std::cout << std::left << std::setw( 10 ) << sample.Name << std::setw( 18 ) << method.Name << std::right
+            << std::fixed << std::setprecision( 2 ) << std::setw( 10 ) << built->getDiskSize()
+            << std::setw( 12 ) << build_seconds * 1e+3 << std::setw( 14 ) << traverse_seconds * 1e+3
+            << std::setw( 10 ) << static_cast<double>(total_visited_num) / count << std::setw( 12 ) << step_bytes
+            << std::setprecision( 4 ) << std::setw( 10 ) << total_error / count << "\n";
+      }
+   }
+}
+
+// the accessibility of a receiver after the first phase of shaders/dynamic/ambient_occlusion.comp, and the number of
+// the elements which are visited to get it. the leaves closer than self_squared_distance are taken as the receiver
+// itself. with brute_force, every leaf element is an emitter. without normal_cones, the subtrees are not culled by
+// their normal cones.
+float getDynamicFirstPhaseAccessibility(
+   int& visited_num,
+   const std::vector<SurfaceElement::ElementForShader>& elements,
+   const glm::vec3& receiver_position,
+   const glm::vec3& receiver_normal,
+   float self_squared_distance,
+   bool brute_force = false,
+   bool normal_cones = true
+)
+{
+   const auto element_size = static_cast<int>(elements.size());
+   float total_shadow = 0.0f;
+   visited_num = 0;
+   for (int emitter = 0; emitter >= 0 && emitter < element_size;) {
+      const SurfaceElement::ElementForShader& e = elements[emitter];
+      visited_num++;
+      glm::vec3 v = e.Position - receiver_position;
+      const float squared_distance = glm::dot( v, v ) + 1e-16f;
+      if (brute_force) {
+         if (e.ChildIndex >= 0) {
+            emitter++;
+            continue;
+         }
+      }
+      else if (e.ChildIndex >= 0 && squared_distance < e.AreaOverPi * 4.0f) {
+         bool culled = false;
+         if (normal_cones) {
+            // the elements cast a shadow on the receiver if it is behind them, so the cone is turned around.
+            float radius, cone_sine;
+            Quantizer::getRadiusAndConeFromPacked( radius, cone_sine, e.RadiusAndCone );
+            culled = OcclusionKernel::isCulledByNormalCone(
+               v, squared_distance, receiver_normal, -Quantizer::getNormalFromOctahedral( e.Normal ), radius,
+               cone_sine
+            );
+         }
+         emitter = culled ? e.NextIndex : e.ChildIndex;
+         continue;
+      }
+      if (e.ChildIndex < 0 && squared_distance < self_squared_distance) {
+         emitter = brute_force ? emitter + 1 : e.NextIndex;
+         continue;
+      }
+      v /= std::sqrt( squared_distance );
+      const glm::vec3 emitter_normal = Quantizer::getNormalFromOctahedral( e.Normal );
+      const float shadow =
+         OcclusionKernel::getElementShadow( v, squared_distance, receiver_normal, emitter_normal, e.AreaOverPi );
+      total_shadow += shadow;
+      emitter = brute_force ? emitter + 1 : e.NextIndex;
+   }
+   return std::clamp( 1.0f - total_shadow, 0.0f, 1.0f );
+}
+
+void printQuantizedRow(
+   const std::string& name,
+   const char* hierarchy,
+   size_t size,
+   size_t full_bytes,
+   size_t quantized_bytes,
+   size_t frame_num,
+   double total_error,
+   double max_error,
+   int count
+)
+{
+   // the quantized hierarchy also uploads its frames.
+   const auto full_size = static_cast<double>(size * full_bytes);
+   const auto quantized_size = static_cast<double>(size * quantized_bytes + frame_num * sizeof( Quantizer::Frame ));
+   std::cout << std::left << std::setw( 10 ) << name << std::setw( 10 ) << hierarchy << std::right
+      << std::setw( 10 ) << size << std::fixed << std::setprecision( 2 )
+      << std::setw( 10 ) << full_size / (1024.0 * 1024.0)
+      << std::setw( 10 ) << quantized_size / (1024.0 * 1024.0)
+      << std::setw( 9 ) << full_size / quantized_size << "x"
+      << std::scientific << std::setprecision( 2 ) << std::setw( 12 ) << total_error / std::max( count, 1 )
+      << std::setw( 12 ) << max_error << "\n";
+}
+
+void benchmarkQuantized()
+{
+   std::cout << "[quantized] the QUANTIZED precision against the FULL one\n";
+   std::cout << "  disks: the emitters of the HOT_COLD layout, with a receiver for every face\n";
+   std::cout << "  elements: the surface elements of the dynamic algorithm, with a receiver for every vertex\n";
+   std::cout << "  error: difference of the accessibility after the first phase of the shaders\n";
+   std::cout << std::left << std::setw( 10 ) << "sample" << std::setw( 10 ) << "hierarchy" << std::right
+      << std::setw( 10 ) << "size" << std::setw( 10 ) << "full MB" << std::setw( 10 ) << "quant MB"
+      << std::setw( 10 ) << "saving" << std::setw( 12 ) << "mean error" << std::setw( 12 ) << "max error" << "\n";
+   for (const auto& sample : getSamples()) {
+      OcclusionTree tree;
+      if (tree.buildOcclusionTree(
+            sample.FilePath, true, OcclusionTree::BUILD_METHOD::MEDIAN_SPLIT, OcclusionTree::DISK_LAYOUT::HOT_COLD
+         ) && tree.getDiskSize() > 0) {
+         std::vector<OcclusionTree::EmitterForShader> emitters, decoded_emitters;
+         std::vector<OcclusionTree::ReceiverForShader> receivers;
+         std::vector<OcclusionTree::QuantizedEmitterForShader> quantized_emitters;
+         tree.getHotColdDisks( emitters, receivers );
+         tree.getQuantizedEmitters( quantized_emitters );
+         decoded_emitters.reserve( quantized_emitters.size() );
+         for (size_t i = 0; i < quantized_emitters.size(); ++i) {
+            decoded_emitters.emplace_back( tree.getEmitterFromQuantized( quantized_emitters[i], static_cast<int>(i) ) );
+         }
+
+         const int face_num = tree.getFaceNum();
+         double total_error = 0.0, max_error = 0.0;
+         int visited_num = 0;
+         for (int f = 0; f < face_num; ++f) {
+            const int receiver = tree.getLeafIndex( f );
+            const float full = getFirstPhaseAccessibility(
+               visited_num, emitters, tree.getProximityTolerance(), tree.getMaxOcclusionDistance(),
+               tree.getRootIndex(), receiver
+            );
+            const float quantized = getFirstPhaseAccessibility(
+               visited_num, decoded_emitters, tree.getProximityTolerance(), tree.getMaxOcclusionDistance(),
+               tree.getRootIndex(), receiver
+            );
+            const double error = std::abs( static_cast<double>(full) - quantized );
+            total_error += error;
+            max_error = std::max( max_error, error );
+         }
+         printQuantizedRow(
+            sample.Name, "disks", emitters.size(), sizeof( OcclusionTree::EmitterForShader ),
+            sizeof( OcclusionTree::QuantizedEmitterForShader ), tree.getQuantizationFrames().size(), total_error,
+            max_error, face_num
+         );
+      }
+
+      SurfaceElement surface;
+      if (!surface.buildSurfaceElements( sample.FilePath, true ) || surface.getElements().empty()) continue;
+
+      const auto& elements = surface.getElements();
+      std::vector<SurfaceElement::QuantizedElementForShader> quantized_elements;
+      std::vector<SurfaceElement::ElementForShader> decoded_elements;
+      surface.getQuantizedElements( quantized_elements );
+      decoded_elements.reserve( quantized_elements.size() );
+      for (size_t i = 0; i < quantized_elements.size(); ++i) {
+         decoded_elements.emplace_back( surface.getElementFromQuantized( quantized_elements[i], static_cast<int>(i) ) );
+      }
+
+      // the receivers are the vertices, which stay in full precision in the vertex buffer.
+      const auto& vertices = surface.getVertices();
+      const auto& normals = surface.getNormals();
+      const auto vertex_num = static_cast<int>(vertices.size());
+      const float self_squared_distance = surface.getSelfSquaredDistance();
+      double total_error = 0.0, max_error = 0.0;
+      int visited_num = 0;
+      for (int v = 0; v < vertex_num; ++v) {
+         const float full = getDynamicFirstPhaseAccessibility( visited_num, elements, vertices[v], normals[v], 0.0f );
+         const float quantized = getDynamicFirstPhaseAccessibility(
+            visited_num, decoded_elements, vertices[v], normals[v], self_squared_distance
+         );
+         const double error = std::abs( static_cast<double>(full) - quantized );
+         total_error += error;
+         max_error = std::max( max_error, error );
+      }
+      printQuantizedRow(
+         sample.Name, "elements", elements.size(), sizeof( SurfaceElement::ElementForShader ),
+         sizeof( SurfaceElement::QuantizedElementForShader ), surface.getQuantizationFrames().size(), total_error,
+         max_error, vertex_num
+      );
+   }
+}
+
+void benchmarkWide(int iterations)
+{
+   std::cout << "[wide] best of " << iterations << " runs, the binary hierarchies and their 4-ary collapses\n";
+   std::cout << "  traverse: first phase of the shaders on the CPU for a receiver of every face or vertex\n";
+   std::cout << "  visited: nodes visited per receiver in the first phase\n";
+   std::cout << "  error: mean difference of the accessibility from the one with all the leaves as emitters\n";
+   std::cout << std::left << std::setw( 10 ) << "sample" << std::setw( 10 ) << "hierarchy" << std::right
+      << std::setw( 8 ) << "width" << std::setw( 10 ) << "nodes" << std::setw( 12 ) << "build ms"
+      << std::setw( 14 ) << "traverse ms" << std::setw( 10 ) << "visited" << std::setw( 10 ) << "error" << "\n";
+   constexpr int receiver_num = 256;
+   const auto print_row = [](
+      const std::string& name,
+      const char* hierarchy,
+      int width,
+      size_t node_num,
+      double build_seconds,
+      double traverse_seconds,
+      double visited_num,
+      double error
+   )
+   {
+      std::cout << std::left << std::setw( 10 ) << name << std::setw( 10 ) << hierarchy << std::right
+         << std::setw( 8 ) << width << std::setw( 10 ) << node_num << std::fixed << std::setprecision( 2 )
+         << std::setw( 12 ) << build_seconds * 1e+3 << std::setw( 14 ) << traverse_seconds * 1e+3
+         << std::setw( 10 ) << visited_num << std::setprecision( 4 ) << std::setw( 10 ) << error << "\n";
+   };
+   for (const auto& sample : getSamples()) {
+      std::vector<float> references;
+      for (const int width : { 2, 4 }) {
+         std::unique_ptr<OcclusionTree> built;
+         bool has_disks = true;
+         const double build_seconds = getBestSeconds(
+            iterations, [&]()
+            {
+               built = std::make_unique<OcclusionTree>();
+               has_disks = built->buildOcclusionTree(
+                  sample.FilePath, false, OcclusionTree::BUILD_METHOD::MEDIAN_SPLIT,
+                  OcclusionTree::DISK_LAYOUT::BUILD_ORDER, width
+               );
+            }
+         );
+         if (!has_disks || built->getDiskSize() == 0) break;
+
+         const int face_num = built->getFaceNum();
+         int visited_num = 0;
+         const double traverse_seconds = getBestSeconds(
+            iterations, [&]()
+            {
+               for (int f = 0; f < face_num; ++f) {
+                  static_cast<void>(getFirstPhaseAccessibility( visited_num, *built, built->getLeafIndex( f ), false ));
+               }
+            }
+         );
+         const int step = std::max( face_num / receiver_num, 1 );
+         const bool has_references = !references.empty();
+         int64_t total_visited_num = 0;
+         double total_error = 0.0;
+         int count = 0;
+         for (int f = 0; f < face_num; f += step, ++count) {
+            const int receiver = built->getLeafIndex( f );
+            if (!has_references) {
+               references.emplace_back( getFirstPhaseAccessibility( visited_num, *built, receiver, true ) );
+            }
+            const float accessibility = getFirstPhaseAccessibility( visited_num, *built, receiver, false );
+            total_visited_num += visited_num;
+            total_error += std::abs( accessibility - references[count] );
+         }
+         print_row(
+            sample.Name, "disks", width, built->getDisks().size(), build_seconds, traverse_seconds,
+            static_cast<double>(total_visited_num) / count, total_error / count
+         );
+      }
+
+      references.clear();
+      for (const int width : { 2, 4 }) {
+         std::unique_ptr<SurfaceElement> built;
+         bool has_elements = true;
+         const double build_seconds = getBestSeconds(
+            iterations, [&]()
+            {
+               built = std::make_unique<SurfaceElement>();
+               has_elements = built->buildSurfaceElements( sample.FilePath, false, width );
+            }
+         );
+         if (!has_elements || built->getElements().empty()) break;
+
+         const auto& elements = built->getElements();
+         const auto& vertices = built->getVertices();
+         const auto& normals = built->getNormals();
+         const auto vertex_num = static_cast<int>(vertices.size());
+         int visited_num = 0;
+         const double traverse_seconds = getBestSeconds(
+            iterations, [&]()
+            {
+               for (int v = 0; v < vertex_num; ++v) {
+                  static_cast<void>(
+                     getDynamicFirstPhaseAccessibility( visited_num, elements, vertices[v], normals[v], 0.0f )
+                  );
+               }
+            }
+         );
+         const int step = std::max( vertex_num / receiver_num, 1 );
+         const bool has_references = !references.empty();
+         int64_t total_visited_num = 0;
+         double total_error = 0.0;
+         int count = 0;
+         for (int v = 0; v < vertex_num; v += step, ++count) {
+            if (!has_references) {
+               references.emplace_back(
+                  getDynamicFirstPhaseAccessibility( visited_num, elements, vertices[v], normals[v], 0.0f, true )
+               );
+            }
+            const float accessibility =
+               getDynamicFirstPhaseAccessibility( visited_num, elements, vertices[v], normals[v], 0.0f );
+            total_visited_num += visited_num;
+            total_error += std::abs( accessibility - references[count] );
+         }
+         print_row(
+            sample.Name, "elements", built->getBranchingFactor(), elements.size(), build_seconds, traverse_seconds,
+            static_cast<double>(total_visited_num) / count, total_error / count
+         );
+      }
+   }
+}
+
+void benchmarkLeafSize(int iterations)
+{
+   std::cout << "[leaf-size] best of " << iterations << " runs without the .aotree cache, with up to this many faces "
+      << "in a leaf disk\n";
+   std::cout << "  pass: first phase of the high quality pass on the CPU for the receivers of all the disks\n";
+   std::cout << "  traverse: first phase for a receiver at the centroid of every face, as the scene pass sees it\n";
+   std::cout << "  visited, triangles: disks visited and form factors of the robust occlusion per face receiver\n";
+   std::cout << "  error: mean difference of the accessibility of a face receiver from the one with all the "
+      << "triangles as emitters\n";
+   std::cout << std::left << std::setw( 10 ) << "sample" << std::right << std::setw( 6 ) << "leaf"
+      << std::setw( 10 ) << "disks" << std::setw( 12 ) << "build ms" << std::setw( 10 ) << "pass ms"
+      << std::setw( 14 ) << "traverse ms" << std::setw( 10 ) << "visited" << std::setw( 11 ) << "triangles"
+      << std::setw( 10 ) << "error" << "\n";
+   constexpr int receiver_num = 256;
+   for (const auto& sample : getSamples()) {
+      OcclusionTree reference;
+      if (!reference.buildOcclusionTree( sample.FilePath, false ) || reference.getDiskSize() == 0) continue;
+
+      // a face receiver is the leaf disk of the face without any other faces.
+      const int face_num = reference.getFaceNum();
+      const int step = std::max( face_num / receiver_num, 1 );
+      std::vector<glm::vec3> positions, normals;
+      std::vector<float> references;
+      for (int f = 0; f < face_num; ++f) {
+         const OcclusionTree::Disk& disk = reference.getDisks()[reference.getLeafIndex( f )];
+         positions.emplace_back( disk.Centroid );
+         normals.emplace_back( disk.Normal );
+      }
+      int visited_num = 0, leaf_face_num = 0;
+      for (int f = 0; f < face_num; f += step) {
+         references.emplace_back(
+            getFirstPhaseAccessibility( visited_num, leaf_face_num, reference, positions[f], normals[f], true )
+         );
+      }
+
+      for (const int leaf_size : { 1, 2, 4, 8 }) {
+         std::unique_ptr<OcclusionTree> built;
+         const double build_seconds = getBestSeconds(
+            iterations, [&]()
+            {
+               built = std::make_unique<OcclusionTree>();
+               static_cast<void>(built->buildOcclusionTree(
+                  sample.FilePath, false, OcclusionTree::BUILD_METHOD::MEDIAN_SPLIT,
+                  OcclusionTree::DISK_LAYOUT::BUILD_ORDER, 2, leaf_size
+               ));
+            }
+         );
+         const int disk_size = built->getDiskSize();
+         const double pass_seconds = getBestSeconds(
+            iterations, [&]()
+            {
+               for (int d = 0; d < disk_size; ++d) {
+                  static_cast<void>(getFirstPhaseAccessibility( visited_num, *built, d, false ));
+               }
+            }
+         );
+         const double traverse_seconds = getBestSeconds(
+            iterations, [&]()
+            {
+               for (int f = 0; f < face_num; ++f) {
+                  static_cast<void>(getFirstPhaseAccessibility(
+                     visited_num, leaf_face_num, *built, positions[f], normals[f], false
+                  ));
+               }
+            }
+         );
+
+         int64_t total_visited_num = 0, total_leaf_face_num = 0;
+         double total_error = 0.0;
+         int count = 0;
+         for (int f = 0; f < face_num; f += step, ++count) {
+            const float accessibility =
+               getFirstPhaseAccessibility( visited_num, leaf_face_num, *built, positions[f], normals[f], false );
+            total_visited_num += visited_num;
+            total_leaf_face_num += leaf_face_num;
+            total_error += std::abs( accessibility - references[count] );
+         }
+         std::cout << std::left << std::setw( 10 ) << sample.Name << std::right << std::setw( 6 ) << leaf_size
+            << std::setw( 10 ) << disk_size << std::fixed << std::setprecision( 2 )
+            << std::setw( 12 ) << build_seconds * 1e+3 << std::setw( 10 ) << pass_seconds * 1e+3
+            << std::setw( 14 ) << traverse_seconds * 1e+3
+            << std::setw( 10 ) << static_cast<double>(total_visited_num) / count
+            << std::setw( 11 ) << static_cast<double>(total_leaf_face_num) / count
+            << std::setprecision( 4 ) << std::setw( 10 ) << total_error / count << "\n";
+      }
+   }
+}
+
+// tiles x tiles copies of a mesh side by side on the xz-plane, written as .obj text.
+std::string getTiledObjectFile(const ObjectMesh& mesh, int tiles, float spacing)
+{
+   std::string text;
+   std::array<char, 64> buffer{};
+   const auto append_number = [&text, &buffer](auto value)
+   {
+      const auto result = std::to_chars( buffer.data(), buffer.data() + buffer.size(), value );
+      text.append( buffer.data(), result.ptr );
+   };
+   for (int z = 0; z < tiles; ++z) {
+      for (int x = 0; x < tiles; ++x) {
+         const glm::vec3 offset(static_cast<float>(x) * spacing, 0.0f, static_cast<float>(z) * spacing);
+         for (const auto& vertex : mesh.Vertices) {
+            const glm::vec3 p = vertex + offset;
+            text += "v ";
+            append_number( p.x );
+            text += ' ';
+            append_number( p.y );
+            text += ' ';
+            append_number( p.z );
+            text += '\n';
+         }
+      }
+   }
+   const auto vertex_num = static_cast<GLuint>(mesh.Vertices.size());
+   for (int t = 0; t < tiles * tiles; ++t) {
+      for (size_t i = 0; i < mesh.VertexIndices.size(); i += 3) {
+         text += 'f';
+         for (size_t j = 0; j < 3; ++j) {
+            text += ' ';
+            append_number( static_cast<GLuint>(t) * vertex_num + mesh.VertexIndices[i + j] + 1 );
+         }
+         text += '\n';
+      }
+   }
+   return text;
+}
+
+void benchmarkMaxDistance(int iterations)
+{
+   std::cout << "[max-distance] best of " << iterations << " runs, the tiger tiled on a grid with the same density\n";
+   std::cout << "  limit: MaxOcclusionDistance over the diameter of one tiger\n";
+   std::cout << "  traverse: first phase of the high quality pass on the CPU for the sampled face receivers\n";
+   std::cout << "  visited: disks visited per receiver in the first phase\n";
+   std::cout << "  error: mean difference of the accessibility from the one with all the triangles within the limit\n";
+   std::cout << std::left << std::setw( 10 ) << "tiles" << std::right << std::setw( 10 ) << "faces"
+      << std::setw( 8 ) << "limit" << std::setw( 14 ) << "traverse ms" << std::setw( 10 ) << "visited"
+      << std::setw( 10 ) << "error" << "\n";
+   constexpr int receiver_num = 1024;
+   ObjectMesh mesh;
+   if (!MeshCache::read( mesh, std::string(CMAKE_SOURCE_DIR) + "/samples/Tiger/tiger.obj" )) return;
+
+   glm::vec3 min_point(std::numeric_limits<float>::max()), max_point(std::numeric_limits<float>::lowest());
+   for (const auto& vertex : mesh.Vertices) {
+      min_point = glm::min( min_point, vertex );
+      max_point = glm::max( max_point, vertex );
+   }
+   const float diameter = glm::distance( min_point, max_point );
+   const float spacing = 1.25f * std::max( max_point.x - min_point.x, max_point.z - min_point.z );
+   const std::filesystem::path tiled_file_path =
+      std::filesystem::temp_directory_path() / "ambient_occlusion_tiled.obj";
+   for (const int tiles : { 1, 2, 4, 8 }) {
+      {
+         std::ofstream file(tiled_file_path, std::ios::binary | std::ios::trunc);
+         file << getTiledObjectFile( mesh, tiles, spacing );
+      }
+      OcclusionTree tree;
+      if (!tree.buildOcclusionTree( tiled_file_path.string(), false ) || tree.getDiskSize() == 0) break;
+
+      const int face_num = tree.getFaceNum();
+      const int step = std::max( face_num / receiver_num, 1 );
+      for (const float limit : { 0.0f, 0.5f, 0.25f }) {
+         tree.setMaxOcclusionDistance( limit * diameter );
+         int visited_num = 0;
+         const double traverse_seconds = getBestSeconds(
+            iterations, [&]()
+            {
+               for (int f = 0; f < face_num; f += step) {
+                  static_cast<void>(getFirstPhaseAccessibility( visited_num, tree, tree.getLeafIndex( f ), false ));
+               }
+            }
+         );
+         int64_t total_visited_num = 0;
+         double total_error = 0.0;
+         int count = 0;
+         for (int f = 0; f < face_num; f += step, ++count) {
+            const int receiver = tree.getLeafIndex( f );
+            const float reference = getFirstPhaseAccessibility( visited_num, tree, receiver, true );
+            const float accessibility = getFirstPhaseAccessibility( visited_num, tree, receiver, false );
+            total_visited_num += visited_num;
+            total_error += std::abs( accessibility - reference );
+         }
+         std::cout << std::left << std::setw( 10 ) << std::to_string( tiles ) + "x" + std::to_string( tiles )
+            << std::right << std::setw( 10 ) << face_num << std::fixed << std::setprecision( 2 );
+         if (limit > 0.0f) std::cout << std::setw( 8 ) << limit;
+         else std::cout << std::setw( 8 ) << "none";
+         std::cout << std::setw( 14 ) << traverse_seconds * 1e+3
+            << std::setw( 10 ) << static_cast<double>(total_visited_num) / count
+            << std::setprecision( 4 ) << std::setw( 10 ) << total_error / count << "\n";
+      }
+   }
+   std::error_code error;
+   std::filesystem::remove( tiled_file_path, error );
+   std::filesystem::remove( MeshCache::getCacheFilePath( tiled_file_path.string(), ".aomesh" ), error );
+}
+
+void benchmarkNormalCone(int iterations)
+{
+   std::cout << "[normal-cone] best of " << iterations << " runs, the subtrees culled by their normal cones\n";
+   std::cout << "  traverse: first phase of the shaders on the CPU for a receiver of every face or vertex\n";
+   std::cout << "  visited: nodes visited per receiver without and with the normal cones\n";
+   std::cout << "  difference: largest difference of the accessibility with the normal cones\n";
+   std::cout << std::left << std::setw( 10 ) << "sample" << std::setw( 11 ) << "hierarchy" << std::right
+      << std::setw( 10 ) << "nodes" << std::setw( 10 ) << "visited" << std::setw( 10 ) << "w/ cones"
+      << std::setw( 9 ) << "fewer" << std::setw( 14 ) << "traverse ms" << std::setw( 10 ) << "w/ cones"
+      << std::setw( 12 ) << "difference" << "\n";
+   // traverse( visited_num, receiver, normal_cones ) returns the accessibility of the receiver.
+   const auto compare = [iterations](
+      const std::string& name,
+      const char* hierarchy,
+      size_t node_num,
+      int receiver_num,
+      const auto& traverse
+   )
+   {
+      std::array<double, 2> seconds{}, visited_nums{};
+      std::array<std::vector<float>, 2> accessibilities;
+      for (int c = 0; c < 2; ++c) {
+         int64_t total_visited_num = 0;
+         accessibilities[c].resize( receiver_num );
+         seconds[c] = getBestSeconds(
+            iterations, [&]()
+            {
+               total_visited_num = 0;
+               for (int r = 0; r < receiver_num; ++r) {
+                  int visited_num = 0;
+                  accessibilities[c][r] = traverse( visited_num, r, c == 1 );
+                  total_visited_num += visited_num;
+               }
+            }
+         );
+         visited_nums[c] = static_cast<double>(total_visited_num) / std::max( receiver_num, 1 );
+      }
+      double max_difference = 0.0;
+      for (int r = 0; r < receiver_num; ++r) {
+         max_difference =
+            std::max( max_difference, std::abs( static_cast<double>(accessibilities[0][r]) - accessibilities[1][r] ) );
+      }
+      std::cout << std::left << std::setw( 10 ) << name << std::setw( 11 ) << hierarchy << std::right
+         << std::setw( 10 ) << node_num << std::fixed << std::setprecision( 2 )
+         << std::setw( 10 ) << visited_nums[0] << std::setw( 10 ) << visited_nums[1]
+         << std::setw( 8 ) << 100.0 * (1.0 - visited_nums[1] / std::max( visited_nums[0], 1.0 )) << "%"
+         << std::setw( 14 ) << seconds[0] * 1e+3 << std::setw( 10 ) << seconds[1] * 1e+3
+         << std::scientific << std::setprecision( 2 ) << std::setw( 12 ) << max_difference << "\n";
+   };
+   for (const auto& sample : getSamples()) {
+      OcclusionTree tree;
+      if (tree.buildOcclusionTree( sample.FilePath, true ) && tree.getDiskSize() > 0) {
+         compare(
+            sample.Name, "disks", tree.getDisks().size(), tree.getFaceNum(),
+            [&tree](int& visited_num, int f, bool normal_cones)
+            {
+               return getFirstPhaseAccessibility( visited_num, tree, tree.getLeafIndex( f ), false, normal_cones );
+            }
+         );
+      }
+
+      OcclusionTree hot_cold_tree;
+      if (hot_cold_tree.buildOcclusionTree(
+            sample.FilePath, true, OcclusionTree::BUILD_METHOD::MEDIAN_SPLIT, OcclusionTree::DISK_LAYOUT::HOT_COLD
+         ) && hot_cold_tree.getDiskSize() > 0) {
+         std::vector<OcclusionTree::QuantizedEmitterForShader> quantized_emitters;
+         std::vector<OcclusionTree::EmitterForShader> emitters;
+         hot_cold_tree.getQuantizedEmitters( quantized_emitters );
+         emitters.reserve( quantized_emitters.size() );
+         for (size_t i = 0; i < quantized_emitters.size(); ++i) {
+            emitters.emplace_back(
+               hot_cold_tree.getEmitterFromQuantized( quantized_emitters[i], static_cast<int>(i) )
+            );
+         }
+         compare(
+            sample.Name, "q-disks", emitters.size(), hot_cold_tree.getFaceNum(),
+            [&hot_cold_tree, &emitters](int& visited_num, int f, bool normal_cones)
+            {
+               return getFirstPhaseAccessibility(
+                  visited_num, emitters, hot_cold_tree.getProximityTolerance(),
+                  hot_cold_tree.getMaxOcclusionDistance(), hot_cold_tree.getRootIndex(),
+                  hot_cold_tree.getLeafIndex( f ), normal_cones
+               );
+            }
+         );
+      }
+
+      SurfaceElement surface;
+      if (!surface.buildSurfaceElements( sample.FilePath, true ) || surface.getElements().empty()) continue;
+
+      const auto& elements = surface.getElements();
+      const auto& vertices = surface.getVertices();
+      const auto& normals = surface.getNormals();
+      const auto vertex_num = static_cast<int>(vertices.size());
+      compare(
+         sample.Name, "elements", elements.size(), vertex_num,
+         [&](int& visited_num, int v, bool normal_cones)
+         {
+            return getDynamicFirstPhaseAccessibility(
+               visited_num, elements, vertices[v], normals[v], 0.0f, false, normal_cones
+            );
+         }
+      );
+
+      std::vector<SurfaceElement::QuantizedElementForShader> quantized_elements;
+      std::vector<SurfaceElement::ElementForShader> decoded_elements;
+      surface.getQuantizedElements( quantized_elements );
+      decoded_elements.reserve( quantized_elements.size() );
+      for (size_t i = 0; i < quantized_elements.size(); ++i) {
+         decoded_elements.emplace_back( surface.getElementFromQuantized( quantized_elements[i], static_cast<int>(i) ) );
+      }
+      const float self_squared_distance = surface.getSelfSquaredDistance();
+      compare(
+         sample.Name, "q-elements", decoded_elements.size(), vertex_num,
+         [&](int& visited_num, int v, bool normal_cones)
+         {
+            return getDynamicFirstPhaseAccessibility(
+               visited_num, decoded_elements, vertices[v], normals[v], self_squared_distance, false, normal_cones
+            );
+         }
+      );
+   }
+}
+
+// the vectors of the solvers are compared bit by bit, so that a different order of the threads is not hidden.
+template<typename T>
+bool isSameBits(const std::vector<T>& a, const std::vector<T>& b)
+{
+   return a.size() == b.size() && (a.empty() || std::memcmp( a.data(), b.data(), a.size() * sizeof( T ) ) == 0);
+}
+
+void benchmarkDynamicCPU(int iterations)
+{
+   constexpr int pass_num = 3;
+   const int max_thread_num = std::max( static_cast<int>(std::thread::hardware_concurrency()), 1 );
+   std::vector<int> thread_nums;
+   for (int n = 1; n < max_thread_num; n *= 2) thread_nums.emplace_back( n );
+   thread_nums.emplace_back( max_thread_num );
+
+   std::cout << "[dynamic-cpu] best of " << iterations << " runs, " << pass_num << " phases of the dynamic pass by "
+      "DynamicOcclusionSolver, " << max_thread_num << " hardware threads\n";
+   std::cout << "  receivers/s: vertices times phases per second\n";
+   std::cout << "  equal: the same bits as the receivers of a single thread\n";
+   std::cout << std::left << std::setw( 10 ) << "sample" << std::setw( 11 ) << "precision" << std::right
+      << std::setw( 10 ) << "vertices" << std::setw( 10 ) << "threads" << std::setw( 12 ) << "ms"
+      << std::setw( 14 ) << "receivers/s" << std::setw( 10 ) << "scaling" << std::setw( 8 ) << "equal" << "\n";
+   for (const auto& sample : getSamples()) {
+      SurfaceElement surface;
+      if (!surface.buildSurfaceElements( sample.FilePath, true ) || surface.getElements().empty()) continue;
+
+      std::vector<SurfaceElement::ReceiverForShader> initial_receivers;
+      surface.getReceivers( initial_receivers );
+      const auto vertex_num = static_cast<double>(initial_receivers.size());
+      for (const auto precision : { Quantizer::PRECISION::FULL, Quantizer::PRECISION::QUANTIZED }) {
+         std::vector<SurfaceElement::ReceiverForShader> serial_receivers;
+         double serial_seconds = 0.0;
+         for (const auto& thread_num : thread_nums) {
+            DynamicOcclusionSolver solver(thread_num);
+            solver.setEmitters( surface, precision );
+            std::vector<SurfaceElement::ReceiverForShader> receivers;
+            const double seconds = getBestSeconds(
+               iterations, [&]()
+               {
+                  receivers = initial_receivers;
+                  solver.solve( receivers, pass_num );
+               }
+            );
+            if (thread_num == 1) {
+               serial_receivers = receivers;
+               serial_seconds = seconds;
+            }
+            std::cout << std::left << std::setw( 10 ) << sample.Name
+               << std::setw( 11 ) << (precision == Quantizer::PRECISION::FULL ? "full" : "quantized") << std::right
+               << std::setw( 10 ) << initial_receivers.size() << std::setw( 10 ) << solver.getThreadNum()
+               << std::fixed << std::setprecision( 2 ) << std::setw( 12 ) << seconds * 1e+3
+               << std::setw( 14 ) << std::setprecision( 0 ) << vertex_num * pass_num / seconds
+               << std::setprecision( 2 ) << std::setw( 9 ) << serial_seconds / seconds << "x"
+               << std::setw( 8 ) << (isSameBits( serial_receivers, receivers ) ? "yes" : "no") << "\n";
+         }
+      }
+   }
+}
+
+void benchmarkHighQualityCPU(int iterations)
+{
+   constexpr int pass_num = 3;
+   const int max_thread_num = std::max( static_cast<int>(std::thread::hardware_concurrency()), 1 );
+   std::vector<int> thread_nums;
+   for (int n = 1; n < max_thread_num; n *= 2) thread_nums.emplace_back( n );
+   thread_nums.emplace_back( max_thread_num );
+
+   std::cout << "[high-quality-cpu] best of " << iterations << " runs, " << pass_num - 1 << " phases of the "
+      "high-quality pass by HighQualityOcclusionSolver, " << max_thread_num << " hardware threads\n";
+   std::cout << "  receivers/s: disks times phases per second\n";
+   std::cout << "  equal: the same bits as the disks of a single thread\n";
+   std::cout << "  difference: largest difference of the first phase from the traversal emulation of the benchmark\n";
+   std::cout << std::left << std::setw( 10 ) << "sample" << std::right
+      << std::setw( 10 ) << "disks" << std::setw( 10 ) << "threads" << std::setw( 12 ) << "ms"
+      << std::setw( 14 ) << "receivers/s" << std::setw( 10 ) << "scaling" << std::setw( 8 ) << "equal"
+      << std::setw( 12 ) << "difference" << "\n";
+   for (const auto& sample : getSamples()) {
+      OcclusionTree tree;
+      if (!tree.buildOcclusionTree( sample.FilePath, true ) || tree.getDiskSize() == 0) continue;
+
+      // the first phase alone is the accessibility which the benchmark emulates for the other modes.
+      double max_difference = 0.0;
+      {
+         HighQualityOcclusionSolver solver;
+         solver.setDisks( tree );
+         solver.solvePhase( true, false );
+         const auto& disks = solver.getDisks();
+         for (int d = 0; d < tree.getDiskSize(); ++d) {
+            int visited_num = 0, leaf_face_num = 0;
+            const float accessibility = getFirstPhaseAccessibility(
+               visited_num, leaf_face_num, tree, disks[d].Centroid, disks[d].Normal, false
+            );
+            // NaN is kept as the largest difference, which std::max() would drop.
+            const double difference = std::abs( static_cast<double>(accessibility) - disks[d].Accessibility );
+            if (!(difference <= max_difference)) max_difference = difference;
+         }
+      }
+
+      std::vector<OcclusionTree::Disk> serial_disks;
+      double serial_seconds = 0.0;
+      for (const auto& thread_num : thread_nums) {
+         HighQualityOcclusionSolver solver(thread_num);
+         const double seconds = getBestSeconds(
+            iterations, [&]()
+            {
+               solver.setDisks( tree );
+               solver.solve( pass_num );
+            }
+         );
+         if (thread_num == 1) {
+            serial_disks = solver.getDisks();
+            serial_seconds = seconds;
+         }
+         std::cout << std::left << std::setw( 10 ) << sample.Name << std::right
+            << std::setw( 10 ) << tree.getDiskSize() << std::setw( 10 ) << solver.getThreadNum()
+            << std::fixed << std::setprecision( 2 ) << std::setw( 12 ) << seconds * 1e+3
+            << std::setw( 14 ) << std::setprecision( 0 )
+            << static_cast<double>(tree.getDiskSize()) * (pass_num - 1) / seconds
+            << std::setprecision( 2 ) << std::setw( 9 ) << serial_seconds / seconds << "x"
+            << std::setw( 8 ) << (isSameBits( serial_disks, solver.getDisks() ) ? "yes" : "no")
+            << std::scientific << std::setw( 12 ) << max_difference << "\n";
+      }
+   }
+}
+
+void benchmarkRobustBake(int iterations)
+{
+   constexpr int pass_num = 3;
+   constexpr double pixel_num = 1920.0 * 1080.0;
+   const int max_thread_num = std::max( static_cast<int>(std::thread::hardware_concurrency()), 1 );
+   std::vector<int> thread_nums;
+   for (int n = 1; n < max_thread_num; n *= 2) thread_nums.emplace_back( n );
+   thread_nums.emplace_back( max_thread_num );
+
+   std::cout << "[robust-bake] best of " << iterations << " runs, the robust occlusion baked per vertex by "
+      "RobustOcclusionBaker after " << pass_num - 1 << " phases, " << max_thread_num << " hardware threads\n";
+   std::cout << "  bake ms: once for a static mesh\n";
+   std::cout << "  per-pixel ms: the same kernel for every pixel of a 1920x1080 frame, which the fragment shader "
+      "evaluates every frame\n";
+   std::cout << "  equal: the same bits as the receivers of a single thread\n";
+   std::cout << std::left << std::setw( 10 ) << "sample" << std::right
+      << std::setw( 10 ) << "vertices" << std::setw( 10 ) << "threads" << std::setw( 12 ) << "bake ms"
+      << std::setw( 14 ) << "receivers/s" << std::setw( 14 ) << "per-pixel ms" << std::setw( 10 ) << "scaling"
+      << std::setw( 8 ) << "equal" << std::setw( 12 ) << "mean AO" << "\n";
+   for (const auto& sample : getSamples()) {
+      OcclusionTree tree;
+      if (!tree.buildOcclusionTree( sample.FilePath, true ) || tree.getDiskSize() == 0) continue;
+
+      HighQualityOcclusionSolver solver;
+      solver.setDisks( tree );
+      solver.solve( pass_num );
+
+      std::vector<SurfaceElement::ReceiverForShader> initial_receivers, serial_receivers;
+      RobustOcclusionBaker::getReceivers( initial_receivers, tree );
+      const auto vertex_num = static_cast<double>(initial_receivers.size());
+      double serial_seconds = 0.0;
+      for (const auto& thread_num : thread_nums) {
+         RobustOcclusionBaker baker(thread_num);
+         baker.setTree( tree, solver.getDisks() );
+         std::vector<SurfaceElement::ReceiverForShader> receivers;
+         const double seconds = getBestSeconds(
+            iterations, [&]()
+            {
+               receivers = initial_receivers;
+               baker.bake( receivers );
+            }
+         );
+         if (thread_num == 1) {
+            serial_receivers = receivers;
+            serial_seconds = seconds;
+         }
+         double mean_accessibility = 0.0;
+         for (const auto& receiver : receivers) mean_accessibility += receiver.Accessibility;
+         mean_accessibility /= std::max( vertex_num, 1.0 );
+         std::cout << std::left << std::setw( 10 ) << sample.Name << std::right
+            << std::setw( 10 ) << receivers.size() << std::setw( 10 ) << baker.getThreadNum()
+            << std::fixed << std::setprecision( 2 ) << std::setw( 12 ) << seconds * 1e+3
+            << std::setw( 14 ) << std::setprecision( 0 ) << vertex_num / seconds
+            << std::setprecision( 2 ) << std::setw( 14 ) << seconds / vertex_num * pixel_num * 1e+3
+            << std::setw( 9 ) << serial_seconds / seconds << "x"
+            << std::setw( 8 ) << (isSameBits( serial_receivers, receivers ) ? "yes" : "no")
+            << std::setprecision( 4 ) << std::setw( 12 ) << mean_accessibility << "\n";
+      }
+   }
+}
+
+void benchmarkPackets(int iterations)
+{
+   constexpr int pass_num = 3;
+
+   std::cout << "[packets] best of " << iterations << " runs, " << pass_num << " phases of the dynamic pass and "
+      << pass_num - 1 << " phases of the high-quality pass on a single thread, traversed by one receiver at a time "
+      "and by packets of " << FloatPacket::Width << " receivers\n";
+   std::cout << "  receivers/s: receivers times phases per second\n";
+   std::cout << "  equal: the same bits as the scalar traversal\n";
+   std::cout << std::left << std::setw( 10 ) << "sample" << std::setw( 24 ) << "solver" << std::right
+      << std::setw( 10 ) << "receivers" << std::setw( 14 ) << "scalar r/s" << std::setw( 14 ) << "packet r/s"
+      << std::setw( 10 ) << "speedup" << std::setw( 8 ) << "equal" << "\n";
+   const auto print = [](
+      const std::string& sample_name,
+      const std::string& solver_name,
+      double receiver_num,
+      double scalar_seconds,
+      double packet_seconds,
+      bool equal
+   )
+   {
+      std::cout << std::left << std::setw( 10 ) << sample_name << std::setw( 24 ) << solver_name << std::right
+         << std::setw( 10 ) << static_cast<int>(receiver_num)
+         << std::fixed << std::setprecision( 0 ) << std::setw( 14 ) << receiver_num / scalar_seconds
+         << std::setw( 14 ) << receiver_num / packet_seconds
+         << std::setprecision( 2 ) << std::setw( 9 ) << scalar_seconds / packet_seconds << "x"
+         << std::setw( 8 ) << (equal ? "yes" : "no") << "\n";
+   };
+   for (const auto& sample : getSamples()) {
+      SurfaceElement surface;
+      if (surface.buildSurfaceElements( sample.FilePath, true ) && !surface.getElements().empty()) {
+         std::vector<SurfaceElement::ReceiverForShader> initial_receivers;
+         surface.getReceivers( initial_receivers );
+         for (const auto precision : { Quantizer::PRECISION::FULL, Quantizer::PRECISION::QUANTIZED }) {
+            DynamicOcclusionSolver solver(1);
+            solver.setEmitters( surface, precision );
+            std::array<std::vector<SurfaceElement::ReceiverForShader>, 2> receivers;
+            std::array<double, 2> seconds{};
+            for (int i = 0; i < 2; ++i) {
+               if (solver.usePackets() != (i == 1)) solver.togglePackets();
+               seconds[i] = getBestSeconds(
+                  iterations, [&]()
+                  {
+                     receivers[i] = initial_receivers;
+                     solver.solve( receivers[i], pass_num );
+                  }
+               );
+            }
+            print(
+               sample.Name, precision == Quantizer::PRECISION::FULL ? "dynamic full" : "dynamic quantized",
+               static_cast<double>(initial_receivers.size()) * pass_num, seconds[0], seconds[1],
+               isSameBits( receivers[0], receivers[1] )
+            );
+         }
+      }
+
+      OcclusionTree tree;
+      if (tree.buildOcclusionTree( sample.FilePath, true ) && tree.getDiskSize() != 0) {
+         HighQualityOcclusionSolver solver(1);
+         std::array<std::vector<OcclusionTree::Disk>, 2> disks;
+         std::array<double, 2> seconds{};
+         for (int i = 0; i < 2; ++i) {
+            if (solver.usePackets() != (i == 1)) solver.togglePackets();
+            seconds[i] = getBestSeconds(
+               iterations, [&]()
+               {
+                  solver.setDisks( tree );
+                  solver.solve( pass_num );
+               }
+            );
+            disks[i] = solver.getDisks();
+         }
+         print(
+            sample.Name, "high-quality", static_cast<double>(tree.getDiskSize()) * (pass_num - 1),
+            seconds[0], seconds[1], isSameBits( disks[0], disks[1] )
+         );
+      }
+   }
+}
+
+int main(int argc, char** argv)
+{
+   const std::string mode = argc > 1 ? argv[1] : "all";
+   const int iterations = argc > 2 ? std::max( std::stoi( argv[2] ), 1 ) : 5;
+   if (mode == "parse" || mode == "all") benchmarkParse( iterations );
+   if (mode == "parse-threads" || mode == "all") benchmarkParseThreads( iterations );
+   if (mode == "mesh-cache" || mode == "all") benchmarkMeshCache( iterations );
+   if (mode == "tree-cache" || mode == "all") benchmarkTreeCache( iterations );
+   if ((mode == "next-links" || mode == "all") && !benchmarkNextLinks()) return EXIT_FAILURE;
+   if (mode == "tree-build" || mode == "all") benchmarkTreeBuild( iterations );
+   if (mode == "element-cache" || mode == "all") benchmarkElementCache( iterations );
+   if (mode == "charts" || mode == "all") benchmarkCharts( iterations );
+   if (mode == "element-build" || mode == "all") benchmarkElementBuild( iterations );
+   if (mode == "quantized" || mode == "all") benchmarkQuantized();
+   if (mode == "wide" || mode == "all") benchmarkWide( iterations );
+   if (mode == "leaf-size" || mode == "all") benchmarkLeafSize( iterations );
+   if (mode == "max-distance" || mode == "all") benchmarkMaxDistance( iterations );
+   if (mode == "normal-cone" || mode == "all") benchmarkNormalCone( iterations );
+   if (mode == "dynamic-cpu" || mode == "all") benchmarkDynamicCPU( iterations );
+   if (mode == "high-quality-cpu" || mode == "all") benchmarkHighQualityCPU( iterations );
+   if (mode == "robust-bake" || mode == "all") benchmarkRobustBake( iterations );
+   if (mode == "packets" || mode == "all") benchmarkPackets( iterations );
+   return 0;
+}
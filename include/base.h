@@ -6,6 +6,7 @@
 #include <common.hpp>
 #include <gtc/type_ptr.hpp>
 #include <gtc/matrix_transform.hpp>
+#include <gtc/packing.hpp>
 #include <gtc/quaternion.hpp>
 
 #define GLM_ENABLE_EXPERIMENTAL
@@ -16,8 +17,11 @@
 #include <iostream>
 #include <iomanip>
 #include <vector>
+#include <array>
+#include <algorithm>
+#include <cstring>
+#include <charconv>
 #include <string>
-#include <regex>
 #include <queue>
 #include <list>
 #include <forward_list>
@@ -29,6 +33,11 @@
 #include <fstream>
 #include <filesystem>
 #include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 
 #include "project_constants.h"
 
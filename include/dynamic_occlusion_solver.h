@@ -0,0 +1,84 @@
+#pragma once
+
+#include "surface_element.h"
+#include "occlusion_kernel.h"
+
+// shaders/dynamic/ambient_occlusion.comp on the CPU, for the machines without a GPU.
+// a receiver is the same vertex as the vertex buffer of SurfaceElement, and every phase traverses the elements for all
+// the receivers in parallel. a receiver reads and writes only itself, so a phase needs no locks.
+// the receivers are traversed in packets of FloatPacket::Width consecutive vertices by default, and one by one if the
+// packets are off. both give the same bits, so the scalar traversal is the reference of the packets.
+class DynamicOcclusionSolver final
+{
+public:
+   // thread_num <= 0 uses all the hardware threads.
+   explicit DynamicOcclusionSolver(int thread_num = 0);
+   ~DynamicOcclusionSolver() = default;
+
+   DynamicOcclusionSolver(const DynamicOcclusionSolver&) = delete;
+   DynamicOcclusionSolver(const DynamicOcclusionSolver&&) = delete;
+   DynamicOcclusionSolver& operator=(const DynamicOcclusionSolver&) = delete;
+   DynamicOcclusionSolver& operator=(const DynamicOcclusionSolver&&) = delete;
+
+   [[nodiscard]] int getThreadNum() const { return Pool.getThreadNum(); }
+   [[nodiscard]] bool useNormalCones() const { return UseNormalCones; }
+   void toggleNormalCones() { UseNormalCones = !UseNormalCones; }
+   [[nodiscard]] bool usePackets() const { return UsePackets; }
+   void togglePackets() { UsePackets = !UsePackets; }
+   // the emitters are the elements of the surface in the precision, as the shader decodes them.
+   // the precision is usually surface.getPrecision(), which is set only by createSurfaceElements().
+   void setEmitters(const SurfaceElement& surface, Quantizer::PRECISION precision);
+   // runs the phases from 1 to pass_num, as RendererGL::calculateDynamicAmbientOcclusion() dispatches them.
+   // the first phase writes only the accessibility, and the later ones also the bent normals.
+   void solve(std::vector<SurfaceElement::ReceiverForShader>& receivers, int pass_num);
+   void solvePhase(std::vector<SurfaceElement::ReceiverForShader>& receivers, int phase);
+
+private:
+   inline static constexpr int BlockSize = 64;
+
+   // an element whose normal, radius, and cone are decoded once instead of at every visit.
+   struct Emitter
+   {
+      glm::vec3 Position;
+      float AreaOverPi;
+      glm::vec3 Normal;
+      int NextIndex;
+      int ChildIndex;
+      float Radius;
+      float ConeSine;
+
+      Emitter() :
+         Position( 0.0f ), AreaOverPi( 0.0f ), Normal( 0.0f ), NextIndex( -1 ), ChildIndex( -1 ), Radius( 0.0f ),
+         ConeSine( 1.0f ) {}
+   };
+
+   bool UseNormalCones;
+   bool UsePackets;
+   // the leaves closer than this are taken as the receiver itself, which is 0 in the FULL precision.
+   float SelfSquaredDistance;
+   std::vector<Emitter> Emitters;
+   ThreadPool Pool;
+
+   [[nodiscard]] bool isCulledByNormalCone(
+      const Emitter& emitter,
+      const glm::vec3& v,
+      float squared_distance,
+      const glm::vec3& receiver_normal
+   ) const;
+   // the lanes where isCulledByNormalCone() is true.
+   [[nodiscard]] int getCulledMask(
+      const Emitter& emitter,
+      const Vec3Packet& v,
+      const FloatPacket& squared_distance,
+      const Vec3Packet& receiver_normal
+   ) const;
+   static void setReceiver(
+      SurfaceElement::ReceiverForShader& receiver,
+      float total_shadow,
+      const glm::vec3& bent_normal,
+      int phase
+   );
+   void solveReceiver(SurfaceElement::ReceiverForShader& receiver, int phase) const;
+   // the receivers from receivers[0] to receivers[receiver_num - 1], which are at most FloatPacket::Width.
+   void solvePacket(SurfaceElement::ReceiverForShader* receivers, int receiver_num, int phase) const;
+};
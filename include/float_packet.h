@@ -0,0 +1,259 @@
+#pragma once
+
+#include "base.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FLOAT_PACKET_SSE
+#endif
+
+// four floats which are processed together, in SSE registers where they are available and lane by lane elsewhere.
+// every operation rounds each lane as the same scalar operation does, so a traversal of four receivers in a packet
+// gives the same bits as four scalar traversals. it holds as long as the compiler does not contract a * b + c into a
+// fused multiply-add, so CMakeLists.txt builds the sources which use the packets with -ffp-contract=off.
+// min() and max() return the second operand if either is NaN, as minps and maxps do.
+class FloatPacket final
+{
+public:
+   inline static constexpr int Width = 4;
+   // a mask has the bit i set if the lane i is true.
+   inline static constexpr int FullMask = (1 << Width) - 1;
+
+   FloatPacket() : FloatPacket( 0.0f ) {}
+   explicit FloatPacket(float value)
+   {
+#ifdef FLOAT_PACKET_SSE
+      Lanes = _mm_set1_ps( value );
+#else
+      Lanes.fill( value );
+#endif
+   }
+
+   [[nodiscard]] static FloatPacket load(const float* values)
+   {
+      FloatPacket packet;
+#ifdef FLOAT_PACKET_SSE
+      packet.Lanes = _mm_loadu_ps( values );
+#else
+      std::copy_n( values, Width, packet.Lanes.begin() );
+#endif
+      return packet;
+   }
+
+   void store(float* values) const
+   {
+#ifdef FLOAT_PACKET_SSE
+      _mm_storeu_ps( values, Lanes );
+#else
+      std::copy_n( Lanes.begin(), Width, values );
+#endif
+   }
+
+   // flips the sign bit as the scalar negation does, so that the negation of 0 is -0 unlike 0 - 0.
+   friend FloatPacket operator-(const FloatPacket& a)
+   {
+#ifdef FLOAT_PACKET_SSE
+      return FloatPacket(_mm_xor_ps( a.Lanes, _mm_set1_ps( -0.0f ) ));
+#else
+      return apply( a, a, [](float x, float) { return -x; } );
+#endif
+   }
+
+   friend FloatPacket operator+(const FloatPacket& a, const FloatPacket& b)
+   {
+#ifdef FLOAT_PACKET_SSE
+      return FloatPacket(_mm_add_ps( a.Lanes, b.Lanes ));
+#else
+      return apply( a, b, [](float x, float y) { return x + y; } );
+#endif
+   }
+
+   friend FloatPacket operator-(const FloatPacket& a, const FloatPacket& b)
+   {
+#ifdef FLOAT_PACKET_SSE
+      return FloatPacket(_mm_sub_ps( a.Lanes, b.Lanes ));
+#else
+      return apply( a, b, [](float x, float y) { return x - y; } );
+#endif
+   }
+
+   friend FloatPacket operator*(const FloatPacket& a, const FloatPacket& b)
+   {
+#ifdef FLOAT_PACKET_SSE
+      return FloatPacket(_mm_mul_ps( a.Lanes, b.Lanes ));
+#else
+      return apply( a, b, [](float x, float y) { return x * y; } );
+#endif
+   }
+
+   friend FloatPacket operator/(const FloatPacket& a, const FloatPacket& b)
+   {
+#ifdef FLOAT_PACKET_SSE
+      return FloatPacket(_mm_div_ps( a.Lanes, b.Lanes ));
+#else
+      return apply( a, b, [](float x, float y) { return x / y; } );
+#endif
+   }
+
+   [[nodiscard]] static FloatPacket sqrt(const FloatPacket& a)
+   {
+#ifdef FLOAT_PACKET_SSE
+      return FloatPacket(_mm_sqrt_ps( a.Lanes ));
+#else
+      return apply( a, a, [](float x, float) { return std::sqrt( x ); } );
+#endif
+   }
+
+   [[nodiscard]] static FloatPacket min(const FloatPacket& a, const FloatPacket& b)
+   {
+#ifdef FLOAT_PACKET_SSE
+      return FloatPacket(_mm_min_ps( a.Lanes, b.Lanes ));
+#else
+      return apply( a, b, [](float x, float y) { return x < y ? x : y; } );
+#endif
+   }
+
+   [[nodiscard]] static FloatPacket max(const FloatPacket& a, const FloatPacket& b)
+   {
+#ifdef FLOAT_PACKET_SSE
+      return FloatPacket(_mm_max_ps( a.Lanes, b.Lanes ));
+#else
+      return apply( a, b, [](float x, float y) { return x > y ? x : y; } );
+#endif
+   }
+
+   // the same as std::clamp( a, low, high ), which keeps NaN.
+   [[nodiscard]] static FloatPacket clamp(const FloatPacket& a, float low, float high)
+   {
+      return min( FloatPacket(high), max( FloatPacket(low), a ) );
+   }
+
+   // the comparisons are false for NaN, as the scalar ones.
+   [[nodiscard]] static int less(const FloatPacket& a, const FloatPacket& b)
+   {
+#ifdef FLOAT_PACKET_SSE
+      return _mm_movemask_ps( _mm_cmplt_ps( a.Lanes, b.Lanes ) );
+#else
+      return getMask( a, b, [](float x, float y) { return x < y; } );
+#endif
+   }
+
+   [[nodiscard]] static int lessEqual(const FloatPacket& a, const FloatPacket& b)
+   {
+#ifdef FLOAT_PACKET_SSE
+      return _mm_movemask_ps( _mm_cmple_ps( a.Lanes, b.Lanes ) );
+#else
+      return getMask( a, b, [](float x, float y) { return x <= y; } );
+#endif
+   }
+
+   [[nodiscard]] static int greater(const FloatPacket& a, const FloatPacket& b) { return less( b, a ); }
+
+   [[nodiscard]] static int isNaN(const FloatPacket& a)
+   {
+#ifdef FLOAT_PACKET_SSE
+      return _mm_movemask_ps( _mm_cmpunord_ps( a.Lanes, a.Lanes ) );
+#else
+      return getMask( a, a, [](float x, float) { return std::isnan( x ); } );
+#endif
+   }
+
+   // the lanes of a where the mask is set, and the lanes of b elsewhere.
+   [[nodiscard]] static FloatPacket select(int mask, const FloatPacket& a, const FloatPacket& b)
+   {
+#ifdef FLOAT_PACKET_SSE
+      const __m128i bits = _mm_set_epi32( 8, 4, 2, 1 );
+      const __m128 lanes = _mm_castsi128_ps(
+         _mm_cmpeq_epi32( _mm_and_si128( _mm_set1_epi32( mask ), bits ), bits )
+      );
+      return FloatPacket(_mm_or_ps( _mm_and_ps( lanes, a.Lanes ), _mm_andnot_ps( lanes, b.Lanes ) ));
+#else
+      FloatPacket packet;
+      for (int i = 0; i < Width; ++i) packet.Lanes[i] = (mask >> i & 1) != 0 ? a.Lanes[i] : b.Lanes[i];
+      return packet;
+#endif
+   }
+
+private:
+#ifdef FLOAT_PACKET_SSE
+   __m128 Lanes;
+
+   explicit FloatPacket(__m128 lanes) : Lanes( lanes ) {}
+#else
+   std::array<float, Width> Lanes;
+
+   template<typename Function>
+   [[nodiscard]] static FloatPacket apply(const FloatPacket& a, const FloatPacket& b, Function&& function)
+   {
+      FloatPacket packet;
+      for (int i = 0; i < Width; ++i) packet.Lanes[i] = function( a.Lanes[i], b.Lanes[i] );
+      return packet;
+   }
+
+   template<typename Function>
+   [[nodiscard]] static int getMask(const FloatPacket& a, const FloatPacket& b, Function&& function)
+   {
+      int mask = 0;
+      for (int i = 0; i < Width; ++i) mask |= function( a.Lanes[i], b.Lanes[i] ) ? 1 << i : 0;
+      return mask;
+   }
+#endif
+};
+
+// three packets for the x, y, and z of four vectors.
+struct Vec3Packet
+{
+   FloatPacket X;
+   FloatPacket Y;
+   FloatPacket Z;
+
+   Vec3Packet() = default;
+   explicit Vec3Packet(const glm::vec3& v) : X( v.x ), Y( v.y ), Z( v.z ) {}
+   Vec3Packet(const FloatPacket& x, const FloatPacket& y, const FloatPacket& z) : X( x ), Y( y ), Z( z ) {}
+
+   // the lanes are gathered from the vectors at the given member of the structures, one structure per lane.
+   template<typename T>
+   [[nodiscard]] static Vec3Packet load(
+      const std::array<const T*, FloatPacket::Width>& structures,
+      glm::vec3 T::* member
+   )
+   {
+      std::array<float, FloatPacket::Width> x{}, y{}, z{};
+      for (int i = 0; i < FloatPacket::Width; ++i) {
+         const glm::vec3& v = structures[i]->*member;
+         x[i] = v.x;
+         y[i] = v.y;
+         z[i] = v.z;
+      }
+      return { FloatPacket::load( x.data() ), FloatPacket::load( y.data() ), FloatPacket::load( z.data() ) };
+   }
+
+   void store(std::array<glm::vec3, FloatPacket::Width>& vectors) const
+   {
+      std::array<float, FloatPacket::Width> x{}, y{}, z{};
+      X.store( x.data() );
+      Y.store( y.data() );
+      Z.store( z.data() );
+      for (int i = 0; i < FloatPacket::Width; ++i) vectors[i] = glm::vec3(x[i], y[i], z[i]);
+   }
+
+   friend Vec3Packet operator-(const Vec3Packet& a) { return { -a.X, -a.Y, -a.Z }; }
+   friend Vec3Packet operator-(const Vec3Packet& a, const Vec3Packet& b) { return { a.X - b.X, a.Y - b.Y, a.Z - b.Z }; }
+   friend Vec3Packet operator*(const FloatPacket& s, const Vec3Packet& v) { return { s * v.X, s * v.Y, s * v.Z }; }
+   friend Vec3Packet operator/(const Vec3Packet& v, const FloatPacket& s) { return { v.X / s, v.Y / s, v.Z / s }; }
+
+   // the same order as glm::dot(), which adds the products of x, y, and z from the left.
+   [[nodiscard]] static FloatPacket dot(const Vec3Packet& a, const Vec3Packet& b)
+   {
+      return a.X * b.X + a.Y * b.Y + a.Z * b.Z;
+   }
+
+   [[nodiscard]] static Vec3Packet select(int mask, const Vec3Packet& a, const Vec3Packet& b)
+   {
+      return {
+         FloatPacket::select( mask, a.X, b.X ),
+         FloatPacket::select( mask, a.Y, b.Y ),
+         FloatPacket::select( mask, a.Z, b.Z )
+      };
+   }
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "occlusion_tree.h"
+#include "occlusion_kernel.h"
+
+// shaders/high-quality/ambient_occlusion.comp on the CPU, for the machines without a GPU.
+// the disks of the tree are copied into two buffers, and a phase reads the disks from one and writes the bent normals
+// and the accessibilities of the receivers into the other, as the in_disks and out_disks of the shader.
+// the receivers are split into tiles of consecutive disks, and a tile is written by one thread, so a phase needs no
+// locks. a tile is traversed in packets of FloatPacket::Width receivers by default, and one by one if the packets are
+// off, which gives the same bits.
+class HighQualityOcclusionSolver final
+{
+public:
+   // thread_num <= 0 uses all the hardware threads.
+   explicit HighQualityOcclusionSolver(int thread_num = 0);
+   ~HighQualityOcclusionSolver() = default;
+
+   HighQualityOcclusionSolver(const HighQualityOcclusionSolver&) = delete;
+   HighQualityOcclusionSolver(const HighQualityOcclusionSolver&&) = delete;
+   HighQualityOcclusionSolver& operator=(const HighQualityOcclusionSolver&) = delete;
+   HighQualityOcclusionSolver& operator=(const HighQualityOcclusionSolver&&) = delete;
+
+   [[nodiscard]] int getThreadNum() const { return Pool.getThreadNum(); }
+   [[nodiscard]] bool useNormalCones() const { return UseNormalCones; }
+   void toggleNormalCones() { UseNormalCones = !UseNormalCones; }
+   [[nodiscard]] bool usePackets() const { return UsePackets; }
+   void togglePackets() { UsePackets = !UsePackets; }
+   // the disks after the last phase, whose Accessibility and BentNormal are the results.
+   [[nodiscard]] const std::vector<OcclusionTree::Disk>& getDisks() const { return DisksBuffers[TargetBufferIndex]; }
+   // copies the disks and the traversal parameters of the tree, such as ProximityTolerance and DistanceAttenuation.
+   void setDisks(const OcclusionTree& tree);
+   // runs the phases from 1 to pass_num - 1, as RendererGL::calculateHighQualityAmbientOcclusion() dispatches them.
+   void solve(int pass_num);
+   // one dispatch of the shader, which swaps the buffers at the end.
+   void solvePhase(bool first_phase, bool last_phase);
+
+private:
+   inline static constexpr int TileSize = 64;
+
+   bool UseNormalCones;
+   bool UsePackets;
+   int RootIndex;
+   int TargetBufferIndex;
+   float ProximityTolerance;
+   float DistanceAttenuation;
+   float MaxOcclusionDistance;
+   std::array<std::vector<OcclusionTree::Disk>, 2> DisksBuffers;
+   ThreadPool Pool;
+
+   [[nodiscard]] bool isCulledByNormalCone(
+      const OcclusionTree::Disk& emitter,
+      const glm::vec3& v,
+      float squared_distance,
+      const glm::vec3& receiver_normal
+   ) const;
+   // the lanes where isCulledByNormalCone() is true.
+   [[nodiscard]] int getCulledMask(
+      const OcclusionTree::Disk& emitter,
+      const Vec3Packet& v,
+      const FloatPacket& squared_distance,
+      const Vec3Packet& receiver_normal
+   ) const;
+   static void setReceiver(
+      OcclusionTree::Disk& out_receiver,
+      const OcclusionTree::Disk& receiver,
+      float total_shadow,
+      const glm::vec3& bent_normal,
+      bool last_phase
+   );
+   void solveReceiver(
+      OcclusionTree::Disk& out_receiver,
+      const OcclusionTree::Disk& receiver,
+      const std::vector<OcclusionTree::Disk>& in_disks,
+      bool first_phase,
+      bool last_phase
+   ) const;
+   // the receivers from in_disks[begin] to in_disks[begin + receiver_num - 1], which are at most FloatPacket::Width.
+   void solvePacket(
+      std::vector<OcclusionTree::Disk>& out_disks,
+      const std::vector<OcclusionTree::Disk>& in_disks,
+      int begin,
+      int receiver_num,
+      bool first_phase,
+      bool last_phase
+   ) const;
+};
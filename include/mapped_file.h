@@ -0,0 +1,32 @@
+#pragma once
+
+#include "base.h"
+
+// read-only memory mapping of a whole file. the mapping lives as long as this object.
+class MappedFile final
+{
+public:
+   MappedFile();
+   explicit MappedFile(const std::string& file_path);
+   ~MappedFile();
+
+   MappedFile(const MappedFile&) = delete;
+   MappedFile(const MappedFile&&) = delete;
+   MappedFile& operator=(const MappedFile&) = delete;
+   MappedFile& operator=(const MappedFile&&) = delete;
+
+   [[nodiscard]] bool isOpen() const { return Data != nullptr; }
+   [[nodiscard]] const char* data() const { return Data; }
+   [[nodiscard]] const char* end() const { return Data + Size; }
+   [[nodiscard]] size_t size() const { return Size; }
+   bool open(const std::string& file_path);
+   void close();
+
+private:
+   const char* Data;
+   size_t Size;
+#ifdef _WIN32
+   void* FileHandle;
+   void* MappingHandle;
+#endif
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "mapped_file.h"
+#include "object_file_reader.h"
+
+// a binary copy (.aomesh) of a parsed .obj file and its vertex normals, stored next to the .obj file.
+// it is valid while the .obj file keeps its size and modification time, or its contents hash to the same value.
+class MeshCache final
+{
+public:
+   MeshCache() = default;
+   ~MeshCache() = default;
+
+   // fills the mesh from the cache if it is up to date. otherwise, parses the .obj file and rewrites the cache.
+   [[nodiscard]] static bool read(ObjectMesh& mesh, const std::string& obj_file_path);
+   // the hash of the .obj file contents, which is taken from the cache header while the cache is up to date.
+   [[nodiscard]] static bool getSourceHash(uint64_t& source_hash, const std::string& obj_file_path);
+   [[nodiscard]] static std::string getCacheFilePath(const std::string& obj_file_path, const std::string& extension);
+   [[nodiscard]] static uint64_t getHash(const void* data, size_t size, uint64_t hash = HashOffsetBasis);
+
+   // every cache writes its sections with these, so that each section starts at an aligned offset.
+   template<typename T>
+   static void writeStruct(std::ofstream& file, const T& data)
+   {
+      static_assert( std::is_trivially_copyable_v<T> );
+
+      file.write( reinterpret_cast<const char*>(&data), sizeof( T ) );
+      const std::array<char, Alignment> padding{};
+      file.write( padding.data(), static_cast<std::streamsize>(getPaddedSize( sizeof( T ) ) - sizeof( T )) );
+   }
+
+   template<typename T>
+   [[nodiscard]] static bool readStruct(T& data, const char*& ptr, const char* end)
+   {
+      static_assert( std::is_trivially_copyable_v<T> );
+
+      if (static_cast<size_t>(end - ptr) < getPaddedSize( sizeof( T ) )) return false;
+      std::memcpy( &data, ptr, sizeof( T ) );
+      ptr += getPaddedSize( sizeof( T ) );
+      return true;
+   }
+
+   template<typename T>
+   static void writeArray(std::ofstream& file, const std::vector<T>& array)
+   {
+      static_assert( std::is_trivially_copyable_v<T> );
+
+      const auto bytes = static_cast<std::streamsize>(array.size() * sizeof( T ));
+      file.write( reinterpret_cast<const char*>(array.data()), bytes );
+      const std::array<char, Alignment> padding{};
+      file.write( padding.data(), static_cast<std::streamsize>(getPaddedSize( bytes ) - bytes) );
+   }
+
+   // copies an array written by writeArray out of a mapped file and moves the read position past it.
+   template<typename T>
+   [[nodiscard]] static bool readArray(std::vector<T>& array, size_t size, const char*& ptr, const char* end)
+   {
+      static_assert( std::is_trivially_copyable_v<T> );
+
+      const size_t bytes = size * sizeof( T );
+      if (static_cast<size_t>(end - ptr) < getPaddedSize( bytes )) return false;
+      array.resize( size );
+      if (bytes > 0) std::memcpy( array.data(), ptr, bytes );
+      ptr += getPaddedSize( bytes );
+      return true;
+   }
+
+   [[nodiscard]] static size_t getPaddedSize(size_t bytes) { return (bytes + Alignment - 1) / Alignment * Alignment; }
+   [[nodiscard]] static std::string getTemporaryFilePath(const std::string& file_path) { return file_path + ".tmp"; }
+   // replaces the cache with its completely written temporary file, so that a reader never maps a half-written one.
+   static void commitTemporaryFile(const std::string& file_path);
+
+private:
+   inline static constexpr uint32_t Version = 1;
+   inline static constexpr size_t Alignment = 16;
+   inline static constexpr uint64_t HashOffsetBasis = 0xcbf29ce484222325ull;
+   inline static constexpr uint64_t HashPrime = 0x100000001b3ull;
+
+   struct Header
+   {
+      std::array<char, 8> Magic;
+      uint32_t Version;
+      uint32_t Reserved;
+      uint64_t SourceSize;
+      int64_t SourceTime;
+      uint64_t SourceHash;
+      uint64_t VertexNum;
+      uint64_t NormalNum;
+      uint64_t TextureNum;
+      uint64_t VertexIndexNum;
+      uint64_t NormalIndexNum;
+      uint64_t TextureIndexNum;
+
+      Header() :
+         Magic{ 'A', 'O', 'M', 'E', 'S', 'H', '\0', '\0' }, Version( MeshCache::Version ), Reserved( 0 ),
+         SourceSize( 0 ), SourceTime( 0 ), SourceHash( 0 ), VertexNum( 0 ), NormalNum( 0 ), TextureNum( 0 ),
+         VertexIndexNum( 0 ), NormalIndexNum( 0 ), TextureIndexNum( 0 ) {}
+   };
+
+   [[nodiscard]] static bool getSourceStatus(
+      uint64_t& source_size,
+      int64_t& source_time,
+      const std::string& obj_file_path
+   );
+   [[nodiscard]] static bool readHeader(Header& header, const char*& ptr, const MappedFile& cache);
+   [[nodiscard]] static bool load(ObjectMesh& mesh, const Header& header, const char* ptr, const char* end);
+   static void save(const ObjectMesh& mesh, const Header& header, const std::string& cache_file_path);
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "shader.h"
+#include "mesh_cache.h"
 
 class ObjectGL
 {
@@ -115,11 +116,6 @@ protected:
       std::vector<glm::vec3>& normals,
       std::vector<glm::vec2>& textures
    );
-   static void findNormals(
-      std::vector<glm::vec3>& normals,
-      const std::vector<glm::vec3>& vertices,
-      const std::vector<GLuint>& vertex_indices
-   );
    [[nodiscard]] static bool readObjectFile(
       std::vector<glm::vec3>& vertices,
       std::vector<glm::vec3>& normals,
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "base.h"
+
+// the indexed contents of an .obj file as they are written in the file.
+// all index arrays are 0-based and have one entry per triangle corner. polygons are triangulated as fans.
+// TextureIndices and NormalIndices are only meaningful when their sizes are equal to VertexIndices.size().
+// VertexNormals are not in the file. they are the area-weighted face normals averaged at each vertex.
+struct ObjectMesh
+{
+   uint64_t SourceHash;
+   std::vector<glm::vec3> Vertices;
+   std::vector<glm::vec3> Normals;
+   std::vector<glm::vec2> Textures;
+   std::vector<GLuint> VertexIndices;
+   std::vector<GLuint> NormalIndices;
+   std::vector<GLuint> TextureIndices;
+   std::vector<glm::vec3> VertexNormals;
+
+   ObjectMesh() : SourceHash( 0 ) {}
+
+   [[nodiscard]] bool hasTextures() const
+   {
+      return !Textures.empty() && TextureIndices.size() == VertexIndices.size();
+   }
+   [[nodiscard]] bool hasNormals() const
+   {
+      return !Normals.empty() && NormalIndices.size() == VertexIndices.size();
+   }
+   void clear()
+   {
+      SourceHash = 0;
+      Vertices.clear();
+      Normals.clear();
+      Textures.clear();
+      VertexIndices.clear();
+      NormalIndices.clear();
+      TextureIndices.clear();
+      VertexNormals.clear();
+   }
+   void findVertexNormals();
+};
+
+class ObjectFileReader final
+{
+public:
+   ObjectFileReader() = default;
+   ~ObjectFileReader() = default;
+
+   // thread_num <= 0 uses all the hardware threads. the result does not depend on thread_num.
+   [[nodiscard]] static bool read(ObjectMesh& mesh, const std::string& file_path, int thread_num = 0);
+   static void parse(ObjectMesh& mesh, const char* begin, const char* end, int thread_num = 0);
+
+private:
+   // a chunk smaller than this is not worth a thread of its own.
+   inline static constexpr size_t MinChunkSize = 1 << 20;
+
+   struct Corner
+   {
+      bool HasTexture;
+      bool HasNormal;
+      GLuint Vertex;
+      GLuint Texture;
+      GLuint Normal;
+
+      Corner() : HasTexture( false ), HasNormal( false ), Vertex( 0 ), Texture( 0 ), Normal( 0 ) {}
+   };
+
+   // the number of elements which are read before a chunk. negative indices are relative to these.
+   struct Offset
+   {
+      size_t Vertex;
+      size_t Texture;
+      size_t Normal;
+
+      Offset() : Vertex( 0 ), Texture( 0 ), Normal( 0 ) {}
+   };
+
+   struct Chunk
+   {
+      bool HasRelativeIndex;
+      const char* Begin;
+      const char* End;
+      Offset ElementOffset;
+      Offset IndexOffset;
+      ObjectMesh Mesh;
+
+      Chunk() : HasRelativeIndex( false ), Begin( nullptr ), End( nullptr ) {}
+   };
+
+   [[nodiscard]] static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+   [[nodiscard]] static const char* skipSpaces(const char* ptr, const char* end)
+   {
+      while (ptr < end && isSpace( *ptr )) ++ptr;
+      return ptr;
+   }
+   [[nodiscard]] static const char* skipLine(const char* ptr, const char* end)
+   {
+      const auto* new_line = static_cast<const char*>(std::memchr( ptr, '\n', end - ptr ));
+      return new_line == nullptr ? end : new_line + 1;
+   }
+   [[nodiscard]] static GLuint getIndex(int index, size_t count, bool& is_relative)
+   {
+      // obj indices are 1-based, and negative ones are relative to the end of the list read so far.
+      if (index > 0) return static_cast<GLuint>(index - 1);
+      is_relative = true;
+      return static_cast<GLuint>(static_cast<int>(count) + index);
+   }
+   [[nodiscard]] static const char* parseFloat(float& value, const char* ptr, const char* end);
+   [[nodiscard]] static const char* parseCorner(Corner& corner, Chunk& chunk, const char* ptr, const char* end);
+   static void addCorner(ObjectMesh& mesh, const Corner& corner);
+   [[nodiscard]] static const char* parseFace(Chunk& chunk, const char* ptr, const char* end);
+   static void parseChunk(Chunk& chunk);
+   static void splitIntoChunks(std::vector<Chunk>& chunks, const char* begin, const char* end, int thread_num);
+   static void mergeChunk(ObjectMesh& mesh, const Chunk& chunk);
+};
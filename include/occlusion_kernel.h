@@ -0,0 +1,125 @@
+#pragma once
+
+#include "float_packet.h"
+
+// the shadow and culling terms of the shaders, which the CPU solvers, the baker, and the benchmark share, so that a fix
+// of one of them cannot land in only one of the copies.
+// every term is the same expression as its shader function, and the packet overloads give the same bits per lane.
+class OcclusionKernel final
+{
+public:
+   OcclusionKernel() = delete;
+
+   // getShadowApproximation() of shaders/high-quality, the shadow of a disk on the receiver.
+   // v is the unit vector from the receiver to the disk, and the area is AreaOverPi.
+   [[nodiscard]] static float getDiskShadow(
+      const glm::vec3& v,
+      float squared_distance,
+      const glm::vec3& receiver_normal,
+      const glm::vec3& emitter_normal,
+      float emitter_area
+   )
+   {
+      return
+         emitter_area / (emitter_area + squared_distance) *
+         std::clamp( glm::dot( emitter_normal, -v ), 0.0f, 1.0f ) *
+         std::clamp( glm::dot( receiver_normal, v ), 0.0f, 1.0f );
+   }
+
+   [[nodiscard]] static FloatPacket getDiskShadow(
+      const Vec3Packet& v,
+      const FloatPacket& squared_distance,
+      const Vec3Packet& receiver_normal,
+      const glm::vec3& emitter_normal,
+      float emitter_area
+   )
+   {
+      const FloatPacket area(emitter_area);
+      return
+         area / (area + squared_distance) *
+         FloatPacket::clamp( Vec3Packet::dot( Vec3Packet(emitter_normal), -v ), 0.0f, 1.0f ) *
+         FloatPacket::clamp( Vec3Packet::dot( receiver_normal, v ), 0.0f, 1.0f );
+   }
+
+   // getShadowApproximation() of shaders/dynamic, the shadow of a surface element on the receiver.
+   [[nodiscard]] static float getElementShadow(
+      const glm::vec3& v,
+      float squared_distance,
+      const glm::vec3& receiver_normal,
+      const glm::vec3& emitter_normal,
+      float emitter_area
+   )
+   {
+      return
+         (1.0f - 1.0f / std::sqrt( emitter_area / squared_distance + 1.0f )) *
+         std::clamp( glm::dot( emitter_normal, v ), 0.0f, 1.0f ) *
+         std::clamp( 4.0f * glm::dot( receiver_normal, v ), 0.0f, 1.0f );
+   }
+
+   [[nodiscard]] static FloatPacket getElementShadow(
+      const Vec3Packet& v,
+      const FloatPacket& squared_distance,
+      const Vec3Packet& receiver_normal,
+      const glm::vec3& emitter_normal,
+      float emitter_area
+   )
+   {
+      const FloatPacket one(1.0f);
+      return
+         (one - one / FloatPacket::sqrt( FloatPacket(emitter_area) / squared_distance + one )) *
+         FloatPacket::clamp( Vec3Packet::dot( Vec3Packet(emitter_normal), v ), 0.0f, 1.0f ) *
+         FloatPacket::clamp( FloatPacket(4.0f) * Vec3Packet::dot( receiver_normal, v ), 0.0f, 1.0f );
+   }
+
+   // isCulledByNormalCone() of the shaders, where the emitters in the sphere of the radius, whose normals are in the
+   // cone of the axis, cast no shadow on the receiver behind all of them. v is the vector from the receiver to the
+   // center of the sphere. the surface elements cast a shadow on the receiver behind them, so their axis is turned
+   // around by the caller.
+   [[nodiscard]] static bool isCulledByNormalCone(
+      const glm::vec3& v,
+      float squared_distance,
+      const glm::vec3& receiver_normal,
+      const glm::vec3& axis,
+      float radius,
+      float cone_sine
+   )
+   {
+      if (glm::dot( receiver_normal, v ) < -radius) return true;
+      if (cone_sine >= 1.0f || squared_distance <= radius * radius) return false;
+
+      const float distance = std::sqrt( squared_distance );
+      const float sphere_sine = radius / distance;
+      const float sphere_cosine = std::sqrt( 1.0f - sphere_sine * sphere_sine );
+      const float cone_cosine = std::sqrt( 1.0f - cone_sine * cone_sine );
+      if (cone_cosine * sphere_cosine <= cone_sine * sphere_sine) return false;
+      return glm::dot( axis, v ) > distance * (cone_sine * sphere_cosine + cone_cosine * sphere_sine);
+   }
+
+   // the lanes where isCulledByNormalCone() is true.
+   [[nodiscard]] static int getCulledMask(
+      const Vec3Packet& v,
+      const FloatPacket& squared_distance,
+      const Vec3Packet& receiver_normal,
+      const glm::vec3& axis,
+      float radius,
+      float cone_sine
+   )
+   {
+      const int below = FloatPacket::less( Vec3Packet::dot( receiver_normal, v ), FloatPacket(-radius) );
+      if (cone_sine >= 1.0f) return below;
+
+      const int inside = FloatPacket::lessEqual( squared_distance, FloatPacket(radius * radius) );
+      const FloatPacket one(1.0f);
+      const FloatPacket sine(cone_sine);
+      const FloatPacket cosine(std::sqrt( 1.0f - cone_sine * cone_sine ));
+      const FloatPacket distance = FloatPacket::sqrt( squared_distance );
+      const FloatPacket sphere_sine = FloatPacket(radius) / distance;
+      const FloatPacket sphere_cosine = FloatPacket::sqrt( one - sphere_sine * sphere_sine );
+      const int wide = FloatPacket::lessEqual( cosine * sphere_cosine, sine * sphere_sine );
+      const int behind = FloatPacket::greater(
+         Vec3Packet::dot( Vec3Packet(axis), v ),
+         distance * (sine * sphere_cosine + cosine * sphere_sine)
+      );
+      return below | (behind & ~inside & ~wide & FloatPacket::FullMask);
+   }
+};
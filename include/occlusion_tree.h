@@ -1,24 +1,166 @@
 #pragma once
 
 #include "object.h"
+#include "quantizer.h"
+#include "thread_pool.h"
 
 class OcclusionTree : public ObjectGL
 {
 public:
+   inline static int NullIndex = -1;
+
+   // MEDIAN_SPLIT recursively splits the faces at the median along the longest side of their centroid boundary.
+   // MORTON_CODE sorts the faces along a Morton curve and emits a linear BVH from the sorted codes.
+   enum class BUILD_METHOD { MEDIAN_SPLIT = 0, MORTON_CODE };
+   // BUILD_ORDER keeps the leaves first in the order of their faces in LeafFaces, and the internal disks after them.
+   // DEPTH_FIRST stores the children of a disk next to each other, and then the subtree of each child in the same way,
+   // so that a receiver reads a sibling group from the same cache lines.
+   // HOT_COLD is DEPTH_FIRST on the CPU, but the shaders get what the traversal reads from an emitter in one buffer,
+   // and what is written for a receiver in another buffer, instead of the whole disks.
+   enum class DISK_LAYOUT { BUILD_ORDER = 0, DEPTH_FIRST, HOT_COLD };
+   // a branching factor of 4 collapses the binary tree, so that an internal disk has up to 4 children.
+   // the children are stored next to each other in every layout, from LeftChildIndex to RightChildIndex.
+   // it only reduces the number of internal disks, as a receiver still tests one disk per step.
+   inline static constexpr int MaxBranchingFactor = 4;
+   // a leaf disk stands for up to this many faces, which are close to each other in the build order.
+   inline static constexpr int MaxLeafSize = 8;
+
+   struct Disk
+   {
+      alignas(4) int ParentIndex;
+      alignas(4) int NextIndex;
+      alignas(4) int LeftChildIndex;
+      alignas(4) int RightChildIndex;
+      alignas(4) float AreaOverPi;
+      alignas(4) float Accessibility;
+      // the faces of a leaf are LeafFaces[FaceBegin, FaceBegin + FaceCount), and an internal disk has none.
+      alignas(4) int FaceBegin;
+      alignas(4) int FaceCount;
+      alignas(16) glm::vec3 Centroid;
+      // the radius of the sphere around the centroid which bounds every triangle of the subtree.
+      alignas(4) float Radius;
+      alignas(16) glm::vec3 Normal;
+      // the sine of the half angle of the cone around the normal which holds the normals of every disk and triangle of
+      // the subtree. it is 1 if the cone is a half space or wider, which never culls anything.
+      alignas(4) float ConeSine;
+      alignas(16) glm::vec3 BentNormal;
+
+      Disk() :
+         ParentIndex( NullIndex ), NextIndex( NullIndex ), LeftChildIndex( NullIndex ), RightChildIndex( NullIndex ),
+         AreaOverPi( 0.0f ), Accessibility( 1.0f ), FaceBegin( NullIndex ), FaceCount( 0 ), Centroid( 0.0f ),
+         Radius( 0.0f ), Normal( 0.0f ), ConeSine( 1.0f ), BentNormal( 0.0f ) {}
+      explicit Disk(int parent_index) :
+         ParentIndex( parent_index ), NextIndex( NullIndex ), LeftChildIndex( NullIndex ), RightChildIndex( NullIndex ),
+         AreaOverPi( 0.0f ), Accessibility( 1.0f ), FaceBegin( NullIndex ), FaceCount( 0 ), Centroid( 0.0f ),
+         Radius( 0.0f ), Normal( 0.0f ), ConeSine( 1.0f ), BentNormal( 0.0f ) {}
+   };
+
+   // 32 bytes as SurfaceElement::ElementForShader, where the normal is octahedral, and the radius and the cone, which
+   // is widened by Quantizer::getOctahedralConeSine(), are encoded by Quantizer::getRadiusAndCone().
+   // the child is the first of the sibling group of the emitter's children, and an emitter without it is a leaf.
+   struct EmitterForShader
+   {
+      alignas(16) glm::vec3 Centroid;
+      alignas(4) float AreaOverPi;
+      alignas(4) uint32_t Normal;
+      alignas(4) int NextIndex;
+      alignas(4) int ChildIndex;
+      alignas(4) uint32_t RadiusAndCone;
+
+      EmitterForShader() :
+         Centroid( 0.0f ), AreaOverPi( 0.0f ), Normal( 0 ), NextIndex( NullIndex ), ChildIndex( NullIndex ),
+         RadiusAndCone( 0 ) {}
+   };
+
+   // 24 bytes, the EmitterForShader of the QUANTIZED precision.
+   // the centroid and the area are encoded by Quantizer::getPositionAndArea() in the frame of the emitter, the normal
+   // is octahedral, and the radius and the cone by Quantizer::getRadiusAndCone(). the radius is widened by the
+   // quantization error of the centroids in the frames of the subtree, so that the sphere still bounds the subtree.
+   struct QuantizedEmitterForShader
+   {
+      alignas(4) uint32_t CentroidXY;
+      alignas(4) uint32_t CentroidZAndArea;
+      alignas(4) uint32_t Normal;
+      alignas(4) int NextIndex;
+      alignas(4) int ChildIndex;
+      alignas(4) uint32_t RadiusAndCone;
+
+      QuantizedEmitterForShader() :
+         CentroidXY( 0 ), CentroidZAndArea( 0 ), Normal( 0 ), NextIndex( NullIndex ), ChildIndex( NullIndex ),
+         RadiusAndCone( 0 ) {}
+   };
+
+   struct ReceiverForShader
+   {
+      alignas(16) glm::vec3 BentNormal;
+      alignas(4) float Accessibility;
+
+      ReceiverForShader() : BentNormal( 0.0f ), Accessibility( 1.0f ) {}
+   };
+
    OcclusionTree();
    ~OcclusionTree() override = default;
 
    [[nodiscard]] bool robust() const { return Robust; }
+   [[nodiscard]] DISK_LAYOUT getLayout() const { return Layout; }
+   [[nodiscard]] Quantizer::PRECISION getPrecision() const { return Precision; }
+   // the frame of the index-th disk in the QUANTIZED precision.
+   [[nodiscard]] const Quantizer::Frame& getQuantizationFrame(int index) const
+   {
+      return QuantizationFrames[Quantizer::getFrameIndex( index )];
+   }
+   [[nodiscard]] const std::vector<Quantizer::Frame>& getQuantizationFrames() const { return QuantizationFrames; }
+   [[nodiscard]] int getBranchingFactor() const { return BranchingFactor; }
+   [[nodiscard]] int getLeafSize() const { return LeafSize; }
    [[nodiscard]] int getRootIndex() const { return RootIndex; }
+   [[nodiscard]] int getFaceNum() const { return static_cast<int>(IndexBuffer.size() / 3); }
    [[nodiscard]] int getDiskSize() const { return static_cast<int>(Disks.size()); }
    [[nodiscard]] GLuint getInDisksBuffer() const { return DisksBuffers[TargetBufferIndex]; }
    [[nodiscard]] GLuint getOutDisksBuffer() const { return DisksBuffers[TargetBufferIndex ^ 1]; }
+   [[nodiscard]] GLuint getEmittersBuffer() const { return EmittersBuffer; }
+   [[nodiscard]] GLuint getInReceiversBuffer() const { return ReceiversBuffers[TargetBufferIndex]; }
+   [[nodiscard]] GLuint getOutReceiversBuffer() const { return ReceiversBuffers[TargetBufferIndex ^ 1]; }
    [[nodiscard]] GLuint getIndicesBuffer() const { return IndicesBuffer; }
    [[nodiscard]] GLuint getVerticesBuffer() const { return VerticesBuffer; }
+   [[nodiscard]] GLuint getFaceRangesBuffer() const { return FaceRangesBuffer; }
+   [[nodiscard]] GLuint getQuantizationFramesBuffer() const { return QuantizationFramesBuffer; }
+   [[nodiscard]] const std::vector<Disk>& getDisks() const { return Disks; }
+   [[nodiscard]] const std::vector<int>& getLeafFaces() const { return LeafFaces; }
+   [[nodiscard]] const std::vector<glm::vec3>& getVertices() const { return Vertices; }
+   [[nodiscard]] const std::vector<glm::vec3>& getNormals() const { return Normals; }
+   [[nodiscard]] const std::vector<GLuint>& getIndices() const { return IndexBuffer; }
+   // the leaf disk of a face.
+   [[nodiscard]] int getLeafIndex(int face_index) const { return FaceDisks[face_index]; }
    [[nodiscard]] float getProximityTolerance() const { return ProximityTolerance; }
    [[nodiscard]] float getDistanceAttenuation() const { return DistanceAttenuation; }
+   // the emitters farther than this from a receiver are culled with their subtrees. the maximum float is no limit.
+   [[nodiscard]] float getMaxOcclusionDistance() const { return MaxOcclusionDistance; }
    [[nodiscard]] float getTriangleAttenuation() const { return TriangleAttenuation; }
-   void createOcclusionTree(const std::string& obj_file_path);
+   // the QUANTIZED precision applies to the emitters of the HOT_COLD layout, and the other layouts ignore it.
+   void createOcclusionTree(
+      const std::string& obj_file_path,
+      BUILD_METHOD build_method = BUILD_METHOD::MEDIAN_SPLIT,
+      DISK_LAYOUT layout = DISK_LAYOUT::BUILD_ORDER,
+      int branching_factor = 2,
+      int leaf_size = 1,
+      Quantizer::PRECISION precision = Quantizer::PRECISION::FULL
+   );
+   // the part of createOcclusionTree which does not need an OpenGL context.
+   // the disks are loaded from the .aotree cache next to the .obj file if it matches the mesh and the build settings.
+   [[nodiscard]] bool buildOcclusionTree(
+      const std::string& obj_file_path,
+      bool use_cache = true,
+      BUILD_METHOD build_method = BUILD_METHOD::MEDIAN_SPLIT,
+      DISK_LAYOUT layout = DISK_LAYOUT::BUILD_ORDER,
+      int branching_factor = 2,
+      int leaf_size = 1
+   );
+   // the buffers of the HOT_COLD layout. the receivers have no bent normals yet and are fully accessible.
+   void getHotColdDisks(std::vector<EmitterForShader>& emitters, std::vector<ReceiverForShader>& receivers) const;
+   // the emitters of the HOT_COLD layout in the QUANTIZED precision, each in the frame of its block of the disks.
+   void getQuantizedEmitters(std::vector<QuantizedEmitterForShader>& emitters) const;
+   // the index-th emitter as the shaders decode it from getQuantizedEmitters().
+   [[nodiscard]] EmitterForShader getEmitterFromQuantized(const QuantizedEmitterForShader& emitter, int index) const;
    void setBuffer();
    void swapBuffers() { TargetBufferIndex ^= 1; }
    void toggleRobustSwitch() { Robust = !Robust; }
@@ -27,59 +169,126 @@ public:
    {
       DistanceAttenuation = std::clamp( DistanceAttenuation + delta, 0.0f, 1.0f );
    }
+   void setMaxOcclusionDistance(float distance)
+   {
+      MaxOcclusionDistance = distance > 0.0f ? distance : std::numeric_limits<float>::max();
+   }
+   // the first scale starts from the diameter of the model, and the distance is no limit again if it reaches it.
+   void scaleMaxOcclusionDistance(float factor);
    void adjustTriangleAttenuation(float delta)
    {
       TriangleAttenuation = std::clamp( TriangleAttenuation + delta, 0.0f, 1.0f );
    }
 
 private:
-   inline static int NullIndex = -1;
+   // each axis of a Morton code has this many bits, and a code is stored in the upper half of a 64-bit key.
+   inline static constexpr int MortonBitsPerAxis = 10;
+   inline static constexpr int RadixBits = 8;
+   inline static constexpr int BuildBlockSize = 1 << 12;
+   // a range with more faces than this is split before it is built, so that its halves can be built in parallel.
+   inline static constexpr int ParallelBuildThreshold = 1 << 12;
+   // a cone is widened by this for the rounding of the angles which are added up to it.
+   inline static constexpr float ConeAngleError = 1.0f / (1 << 20);
 
-   struct Disk
+   // the faces in [Begin, End) of Faces, whose internal disks are placed in Disks from Node.
+   struct DiskRange
    {
-      alignas(4) int ParentIndex;
-      alignas(4) int NextIndex;
-      alignas(4) int LeftChildIndex;
-      alignas(4) int RightChildIndex;
-      alignas(4) float AreaOverPi;
-      alignas(4) float Accessibility;
-      alignas(16) glm::vec3 Centroid;
-      alignas(16) glm::vec3 Normal;
-      alignas(16) glm::vec3 BentNormal;
+      int Begin;
+      int End;
+      int Node;
+      int ParentIndex;
 
-      Disk() :
-         ParentIndex( NullIndex ), NextIndex( NullIndex ), LeftChildIndex( NullIndex ), RightChildIndex( NullIndex ),
-         AreaOverPi( 0.0f ), Accessibility( 1.0f ), Centroid( 0.0f ), Normal( 0.0f ), BentNormal( 0.0f ) {}
-      explicit Disk(int parent_index) :
-         ParentIndex( parent_index ), NextIndex( NullIndex ), LeftChildIndex( NullIndex ), RightChildIndex( NullIndex ),
-         AreaOverPi( 0.0f ), Accessibility( 1.0f ), Centroid( 0.0f ), Normal( 0.0f ), BentNormal( 0.0f ) {}
+      DiskRange() : Begin( 0 ), End( 0 ), Node( 0 ), ParentIndex( NullIndex ) {}
+      DiskRange(int begin, int end, int node, int parent_index) :
+         Begin( begin ), End( end ), Node( node ), ParentIndex( parent_index ) {}
    };
 
    bool Robust;
    int RootIndex;
+   int BranchingFactor;
+   int LeafSize;
    int TargetBufferIndex;
    std::array<GLuint, 2> DisksBuffers;
+   GLuint EmittersBuffer;
+   std::array<GLuint, 2> ReceiversBuffers;
    GLuint IndicesBuffer;
    GLuint VerticesBuffer;
+   GLuint FaceRangesBuffer;
+   GLuint QuantizationFramesBuffer;
    float ProximityTolerance;
    float DistanceAttenuation;
+   float MaxOcclusionDistance;
    float TriangleAttenuation;
+   BUILD_METHOD BuildMethod;
+   DISK_LAYOUT Layout;
+   Quantizer::PRECISION Precision;
+   std::vector<Quantizer::Frame> QuantizationFrames;
    std::vector<Disk> Disks;
+   // the leaf disk of each face.
+   std::vector<int> FaceDisks;
+   // the faces in the order of the leaves, so that the faces of a leaf are next to each other.
+   std::vector<int> LeafFaces;
+   // the faces and the sums of their vertices, which are only kept while the disks are built.
+   // the builders leave the faces of the leaf i in Faces[LeafSize * i, LeafSize * (i + 1)).
+   std::vector<int> Faces;
+   std::vector<glm::vec3> TripleCentroids;
    std::vector<glm::vec3> Vertices;
+   std::vector<glm::vec3> Normals;
 
-   [[nodiscard]] bool readObjectFile(std::vector<glm::vec3>& normals, const std::string& file_path);
-   void getBoundary(
-      glm::vec3& min_point,
-      glm::vec3& max_point,
-      const std::vector<int>::iterator& begin,
-      const std::vector<int>::iterator& end
-   );
+   // bump it whenever build() produces different disks for the same mesh, so that old caches are not used.
+   inline static constexpr uint32_t BuilderVersion = 7;
+   inline static constexpr uint32_t DiskCacheVersion = 5;
+
+   struct DiskCacheHeader
+   {
+      std::array<char, 8> Magic;
+      uint32_t Version;
+      uint32_t DiskBytes;
+      uint64_t SourceHash;
+      uint64_t SettingsHash;
+      int32_t RootIndex;
+      uint32_t Reserved;
+      uint64_t DiskNum;
+      uint64_t FaceDiskNum;
+      uint64_t LeafFaceNum;
+
+      DiskCacheHeader() :
+         Magic{ 'A', 'O', 'T', 'R', 'E', 'E', '\0', '\0' }, Version( DiskCacheVersion ),
+         DiskBytes( static_cast<uint32_t>(sizeof( Disk )) ), SourceHash( 0 ), SettingsHash( 0 ), RootIndex( NullIndex ),
+         Reserved( 0 ), DiskNum( 0 ), FaceDiskNum( 0 ), LeafFaceNum( 0 ) {}
+   };
+
+   [[nodiscard]] bool readObjectFile(uint64_t& source_hash, const std::string& file_path);
+   void setFaces(ThreadPool& thread_pool);
+   void getBoundary(glm::vec3& min_point, glm::vec3& max_point, int begin, int end) const;
    [[nodiscard]] static int getDominantAxis(const glm::vec3& p0, const glm::vec3& p1);
+   [[nodiscard]] static float getAngle(const glm::vec3& u, const glm::vec3& v);
+   [[nodiscard]] static float getConeSine(float angle);
    void setParentDisk(Disk& parent_disk);
-   [[nodiscard]] int build(
-      int parent_index,
-      const std::vector<int>::iterator& begin,
-      const std::vector<int>::iterator& end
-   );
-   [[nodiscard]] int getNextIndex(int index);
+   void setLeafDisk(int leaf_index, int begin, int end, int parent_index);
+   [[nodiscard]] int getLeafNum(int face_num) const { return (face_num + LeafSize - 1) / LeafSize; }
+   // a range of faces always begins at a multiple of LeafSize, so the leaf of a range is its beginning over LeafSize.
+   [[nodiscard]] int getSubtreeRoot(int begin, int end, int node) const
+   {
+      return end - begin <= LeafSize ? begin / LeafSize : node;
+   }
+   [[nodiscard]] int splitDisks(int parent_index, int begin, int end, int node);
+   [[nodiscard]] int build(int parent_index, int begin, int end, int node);
+   [[nodiscard]] int buildWithMedianSplit();
+   void setNextIndices();
+   void collapseDisks();
+   void reorderDisksDepthFirst();
+   [[nodiscard]] static uint32_t getMortonCode(const glm::vec3& point);
+   [[nodiscard]] static int getCommonPrefixLength(uint64_t a, uint64_t b);
+   void getMortonKeys(std::vector<uint64_t>& keys, ThreadPool& thread_pool);
+   static void sortMortonKeys(std::vector<uint64_t>& keys, ThreadPool& thread_pool);
+   [[nodiscard]] int getMortonSplit(const std::vector<uint64_t>& keys, int first, int last) const;
+   void setMortonChildren(const std::vector<uint64_t>& keys, int node);
+   [[nodiscard]] int buildWithMortonCodes();
+   void setLeafFaces();
+   void buildDisks();
+   void setQuantizationFrames();
+   [[nodiscard]] uint64_t getBuildSettingsHash() const;
+   [[nodiscard]] bool loadDisks(const std::string& cache_file_path, uint64_t source_hash);
+   void saveDisks(const std::string& cache_file_path, uint64_t source_hash) const;
 };
\ No newline at end of file
@@ -54,6 +54,7 @@ private:
    GLFWwindow* Window;
    bool Pause;
    bool UseBentNormal;
+   bool UseNormalCones;
    int FrameWidth;
    int FrameHeight;
    int ActiveLightIndex;
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "occlusion_tree.h"
+#include "surface_element.h"
+#include "occlusion_kernel.h"
+
+// calculateRobustOcclusion() of shaders/high-quality/ambient_occlusion.frag on the CPU, evaluated once per vertex of
+// a static mesh instead of once per fragment of every frame.
+// the leaves are replaced by the exact form factors of their triangles, and the internal disks are blended into their
+// children near the proximity zone, as in the fragment shader. the results are written into the accessibilities and
+// bent normals of SurfaceElement::ReceiverForShader, the per-vertex layout which the renderer already draws.
+class RobustOcclusionBaker final
+{
+public:
+   // thread_num <= 0 uses all the hardware threads.
+   explicit RobustOcclusionBaker(int thread_num = 0);
+   ~RobustOcclusionBaker() = default;
+
+   RobustOcclusionBaker(const RobustOcclusionBaker&) = delete;
+   RobustOcclusionBaker(const RobustOcclusionBaker&&) = delete;
+   RobustOcclusionBaker& operator=(const RobustOcclusionBaker&) = delete;
+   RobustOcclusionBaker& operator=(const RobustOcclusionBaker&&) = delete;
+
+   [[nodiscard]] int getThreadNum() const { return Pool.getThreadNum(); }
+   [[nodiscard]] bool useNormalCones() const { return UseNormalCones; }
+   void toggleNormalCones() { UseNormalCones = !UseNormalCones; }
+   // the disks are the in_disks of the fragment shader, which is HighQualityOcclusionSolver::getDisks() after the
+   // phases, so that their accessibilities modulate the emitters. the triangles and the parameters are of the tree.
+   void setTree(const OcclusionTree& tree, const std::vector<OcclusionTree::Disk>& disks);
+   // the receivers of all the vertices of the tree, whose bent normals are the normals.
+   static void getReceivers(std::vector<SurfaceElement::ReceiverForShader>& receivers, const OcclusionTree& tree);
+   void bake(std::vector<SurfaceElement::ReceiverForShader>& receivers);
+
+private:
+   inline static constexpr int BlockSize = 64;
+   // the proximity zone where a parent disk is blended into its children, relative to the proximity distance.
+   inline static constexpr float ZoneRadius = 0.1f;
+
+   bool UseNormalCones;
+   int RootIndex;
+   float ProximityTolerance;
+   float DistanceAttenuation;
+   float MaxOcclusionDistance;
+   float TriangleAttenuation;
+   std::vector<OcclusionTree::Disk> Disks;
+   // the triangles in the order of the leaves, so that the triangles of a leaf are from its FaceBegin.
+   std::vector<std::array<glm::vec3, 3>> Triangles;
+   ThreadPool Pool;
+
+   [[nodiscard]] bool isCulledByNormalCone(
+      const OcclusionTree::Disk& emitter,
+      const glm::vec3& v,
+      float squared_distance,
+      const glm::vec3& receiver_normal
+   ) const;
+   [[nodiscard]] static glm::vec3 getPointOnPlane(
+      const glm::vec3& p0,
+      const glm::vec3& p1,
+      float signed_distance0,
+      float signed_distance1
+   );
+   // the triangle clipped by the tangent plane of the receiver, as a quadrilateral whose last points may be repeated.
+   static void getVisiblePoints(
+      std::array<glm::vec3, 4>& q,
+      const glm::vec3& receiver_position,
+      const glm::vec3& receiver_normal,
+      const std::array<glm::vec3, 3>& triangle
+   );
+   [[nodiscard]] static float calculateFormFactor(
+      const std::array<glm::vec3, 4>& q,
+      const glm::vec3& receiver_position,
+      const glm::vec3& receiver_normal
+   );
+   void bakeReceiver(SurfaceElement::ReceiverForShader& receiver) const;
+};
@@ -1,20 +1,111 @@
 #pragma once
 
 #include "object.h"
+#include "quantizer.h"
+#include "thread_pool.h"
 
 class SurfaceElement : public ObjectGL
 {
 public:
+   // 32 bytes, where the normal is encoded by Quantizer::getOctahedralNormal().
+   // the sphere of the radius around the position bounds the elements of the subtree, and the cone around the normal
+   // holds their normals. both are encoded by Quantizer::getRadiusAndCone().
+   struct ElementForShader
+   {
+      alignas(16) glm::vec3 Position;
+      alignas(4) uint32_t Normal;
+      alignas(4) float AreaOverPi;
+      alignas(4) int NextIndex;
+      alignas(4) int ChildIndex;
+      alignas(4) uint32_t RadiusAndCone;
+
+      ElementForShader() = default;
+   };
+
+   // 24 bytes, where the position and the area are encoded by Quantizer::getPositionAndArea() in the frame of the
+   // element. the radius is widened by the quantization error of the positions in the frames of the subtree, so that
+   // the sphere still bounds the subtree.
+   struct QuantizedElementForShader
+   {
+      alignas(4) uint32_t PositionXY;
+      alignas(4) uint32_t PositionZAndArea;
+      alignas(4) uint32_t Normal;
+      alignas(4) int NextIndex;
+      alignas(4) int ChildIndex;
+      alignas(4) uint32_t RadiusAndCone;
+
+      QuantizedElementForShader() = default;
+   };
+
+   // 40 bytes, a vertex of the vertex buffer, which the shaders read and write as a receiver.
+   struct ReceiverForShader
+   {
+      alignas(4) glm::vec3 Position;
+      alignas(4) glm::vec3 Normal;
+      alignas(4) glm::vec3 BentNormal;
+      alignas(4) float Accessibility;
+
+      ReceiverForShader() : Position( 0.0f ), Normal( 0.0f ), BentNormal( 0.0f ), Accessibility( 1.0f ) {}
+      ReceiverForShader(const glm::vec3& position, const glm::vec3& normal) :
+         Position( position ), Normal( normal ), BentNormal( normal ), Accessibility( 1.0f ) {}
+   };
+
    SurfaceElement();
    ~SurfaceElement() override = default;
 
    [[nodiscard]] GLuint getReceiversBuffer() const { return ReceiversBuffer; }
    [[nodiscard]] GLuint getSurfaceElementsBuffer() const { return SurfaceElementsBuffer; }
-   [[nodiscard]] int getVertexBufferSize() const { return static_cast<int>(VertexList.size()); }
-   void createSurfaceElements(const std::string& obj_file_path);
+   [[nodiscard]] GLuint getQuantizationFramesBuffer() const { return QuantizationFramesBuffer; }
+   [[nodiscard]] int getVertexBufferSize() const { return static_cast<int>(Vertices.size()); }
+   [[nodiscard]] int getBranchingFactor() const { return 2 << BranchingLevels; }
+   [[nodiscard]] Quantizer::PRECISION getPrecision() const { return Precision; }
+   // the frame of the index-th element in the QUANTIZED precision.
+   [[nodiscard]] const Quantizer::Frame& getQuantizationFrame(int index) const
+   {
+      return QuantizationFrames[Quantizer::getFrameIndex( index )];
+   }
+   [[nodiscard]] const std::vector<Quantizer::Frame>& getQuantizationFrames() const { return QuantizationFrames; }
+   // the leaf of a receiver is off by up to one cell of its frame in the QUANTIZED precision, so the leaves closer
+   // than the largest cell of the frames with leaves are taken as the receiver itself.
+   [[nodiscard]] float getSelfSquaredDistance() const { return SelfSquaredDistance; }
+   [[nodiscard]] const std::vector<ElementForShader>& getElements() const { return ElementBuffer; }
+   [[nodiscard]] const std::vector<glm::vec3>& getVertices() const { return Vertices; }
+   [[nodiscard]] const std::vector<glm::vec3>& getNormals() const { return Normals; }
+   // an internal element has up to branching_factor children, which is 2 or 4.
+   void createSurfaceElements(
+      const std::string& obj_file_path,
+      int branching_factor = 4,
+      Quantizer::PRECISION precision = Quantizer::PRECISION::FULL
+   );
+   // the part of createSurfaceElements which does not need an OpenGL context.
+   // the elements and receivers are loaded from the .aoelem cache next to the .obj file if it matches the mesh.
+   [[nodiscard]] bool buildSurfaceElements(
+      const std::string& obj_file_path,
+      bool use_cache = true,
+      int branching_factor = 4
+   );
+   // the elements of the QUANTIZED precision, each in the frame of its block of the elements.
+   void getQuantizedElements(std::vector<QuantizedElementForShader>& elements) const;
+   // the index-th element as the shader decodes it from getQuantizedElements().
+   [[nodiscard]] ElementForShader getElementFromQuantized(const QuantizedElementForShader& element, int index) const;
+   // the receivers of all the vertices before the first phase, whose bent normals are the normals.
+   void getReceivers(std::vector<ReceiverForShader>& receivers) const;
    void setBuffer();
+   // labels each vertex with the UV chart which it belongs to, and returns the number of charts.
+   // the separator of a vertex is its texture coordinate in that chart.
+   [[nodiscard]] static int getChartLabels(
+      std::vector<int>& ids,
+      std::vector<glm::vec2>& separators,
+      size_t vertex_num,
+      const std::vector<glm::vec2>& textures,
+      const std::vector<GLuint>& vertex_indices,
+      const std::vector<GLuint>& texture_indices
+   );
 
 private:
+   inline static constexpr int NullIndex = -1;
+   inline static constexpr int MaxBranchingFactor = 4;
+
    struct Vertex
    {
       int ID;
@@ -30,61 +121,121 @@ private:
          ID( 0 ), Area( area ), Position( position ), Normal( normal ), Separator( separator ) {}
    };
 
+   // a node of the element tree. the tree lives in Elements, and the links are the positions in it.
+   // the radius and the half angle of the cone bound the positions and the normals of the leaves under the node.
    struct Element
    {
       float Area;
+      float Radius;
+      float ConeAngle;
       int Index;
-      int Height;
+      int Next;
+      int Right;
+      int Child;
       glm::vec3 Position;
       glm::vec3 Normal;
+
+      Element() :
+         Area( 0.0f ), Radius( 0.0f ), ConeAngle( 0.0f ), Index( -1 ), Next( NullIndex ), Right( NullIndex ),
+         Child( NullIndex ), Position( 0.0f ), Normal( 0.0f ) {}
+      Element(glm::vec3 position, glm::vec3 normal, float area) :
+         Area( area ), Radius( 0.0f ), ConeAngle( 0.0f ), Index( -1 ), Next( NullIndex ), Right( NullIndex ),
+         Child( NullIndex ), Position( position ), Normal( normal ) {}
+   };
+
+   // the leaves are split by sorting these instead of the elements, which are much larger.
+   struct SplitKey
+   {
       glm::vec2 Separator;
-      std::shared_ptr<Element> Next;
-      std::shared_ptr<Element> Right;
-      std::shared_ptr<Element> Child;
+      int Element;
 
-      Element() : Area( 0.0f ), Index( -1 ), Height( -1 ), Position( 0.0f ), Normal( 0.0f ), Separator( 0.0f ) {}
-      Element(glm::vec3 position, glm::vec3 normal, glm::vec2 separator, float area) :
-         Area( area ), Index( -1 ), Height( -1 ), Position( position ), Normal( normal ), Separator( separator ) {}
+      SplitKey() : Separator( 0.0f ), Element( NullIndex ) {}
+      SplitKey(glm::vec2 separator, int element) : Separator( separator ), Element( element ) {}
    };
 
-   struct ElementForShader
+   // the leaves in [Begin, End) of SplitKeys, whose internal nodes are placed in Elements from Node.
+   struct ElementRange
    {
-      alignas(4) int NextIndex;
-      alignas(4) int ChildIndex;
-      alignas(4) float AreaOverPi;
-      alignas(16) glm::vec3 Position;
-      alignas(16) glm::vec3 Normal;
+      int Begin;
+      int End;
+      int Node;
 
-      ElementForShader() = default;
+      ElementRange() : Begin( 0 ), End( 0 ), Node( 0 ) {}
+      ElementRange(int begin, int end, int node) : Begin( begin ), End( end ), Node( node ) {}
    };
 
    int IDNum;
    int TotalElementSize;
+   int ElementTree;
+   // the levels of the binary tree which are collapsed into the children of an element, log2 of the branching - 1.
+   int BranchingLevels;
    GLuint ReceiversBuffer;
    GLuint SurfaceElementsBuffer;
+   GLuint QuantizationFramesBuffer;
+   Quantizer::PRECISION Precision;
+   std::vector<Quantizer::Frame> QuantizationFrames;
+   float SelfSquaredDistance;
    std::vector<Vertex> VertexList;
-   std::shared_ptr<Element> ElementTree;
+   std::vector<Element> Elements;
+   std::vector<SplitKey> SplitKeys;
    std::vector<ElementForShader> ElementBuffer;
+   std::vector<glm::vec3> Vertices;
+   std::vector<glm::vec3> Normals;
+
+   // bump it whenever buildElements() produces different elements for the same mesh, so that old caches are not used.
+   inline static constexpr uint32_t BuilderVersion = 4;
+   // a subtree with more leaves than this is split before it is built, so that its halves can be built in parallel.
+   inline static constexpr int ParallelBuildThreshold = 1 << 12;
+   inline static constexpr uint32_t ElementCacheVersion = 3;
+
+   struct ElementCacheHeader
+   {
+      std::array<char, 8> Magic;
+      uint32_t Version;
+      uint32_t ElementBytes;
+      uint64_t SourceHash;
+      uint64_t SettingsHash;
+      uint64_t VertexNum;
+      uint64_t IndexNum;
+      uint64_t ElementNum;
+
+      ElementCacheHeader() :
+         Magic{ 'A', 'O', 'E', 'L', 'E', 'M', '\0', '\0' }, Version( ElementCacheVersion ),
+         ElementBytes( static_cast<uint32_t>(sizeof( ElementForShader )) ), SourceHash( 0 ), SettingsHash( 0 ),
+         VertexNum( 0 ), IndexNum( 0 ), ElementNum( 0 ) {}
+   };
 
    void prepareBentNormal();
    void prepareAccessibility();
-   [[nodiscard]] bool setVertexListFromObjectFile(
-      std::vector<glm::vec3>& vertices,
-      std::vector<glm::vec3>& normals,
-      const std::string& file_path
-   );
+   [[nodiscard]] bool setVertexListFromObjectFile(const std::string& file_path);
    [[nodiscard]] static float getTriangleArea(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2);
+   [[nodiscard]] static float getAngle(const glm::vec3& u, const glm::vec3& v);
    void setVertexList(
       const std::vector<glm::vec3>& vertices,
+      const std::vector<glm::vec3>& normals,
       const std::vector<glm::vec2>& textures,
       const std::vector<GLuint>& vertex_indices,
       const std::vector<GLuint>& texture_indices
    );
-   [[nodiscard]] std::shared_ptr<Element> getElementList(int id);
-   static void getBoundary(glm::vec2& min_point, glm::vec2& max_point, std::shared_ptr<Element>& element_list);
-   static float getMedian(std::shared_ptr<Element>& element_list, int dimension, int n, float left, float right);
-   [[nodiscard]] std::shared_ptr<Element> createElementTree(std::shared_ptr<Element>& element_list);
-   static void relocateElementTree(std::shared_ptr<Element>& element);
-   static void linkTree(std::shared_ptr<Element>& element, const std::shared_ptr<Element>& next);
+   void getChartBuckets(std::vector<int>& offsets, std::vector<int>& vertices) const;
+   void setLeafElements(const int* begin, const int* end, int first);
+   void getBoundary(glm::vec2& min_point, glm::vec2& max_point, int begin, int end) const;
+   [[nodiscard]] int getSubtreeRoot(int begin, int end, int node) const
+   {
+      return end - begin == 1 ? SplitKeys[begin].Element : node;
+   }
+   [[nodiscard]] int splitElements(int begin, int end, int node);
+   void createElementTree(int begin, int end, int node);
+   void relocateElementTree(int element);
+   void linkTree(int element, int next);
+   [[nodiscard]] int getNextElement(int element) const
+   {
+      return Elements[element].Child != NullIndex ? Elements[element].Child : Elements[element].Next;
+   }
    void updateAllElements();
+   void setQuantizationFrames();
+   void buildElements();
+   [[nodiscard]] uint64_t getBuildSettingsHash() const;
+   [[nodiscard]] bool loadElements(const std::string& cache_file_path, uint64_t source_hash);
+   void saveElements(const std::string& cache_file_path, uint64_t source_hash) const;
 };
\ No newline at end of file
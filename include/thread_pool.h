@@ -0,0 +1,39 @@
+#pragma once
+
+#include "base.h"
+
+// a fixed set of worker threads which run the tasks of one parallel loop at a time.
+// the tasks are handed out one by one, so uneven tasks are balanced among the threads.
+class ThreadPool final
+{
+public:
+   // thread_num <= 0 uses all the hardware threads. the calling thread of run() counts as one of them.
+   explicit ThreadPool(int thread_num = 0);
+   ~ThreadPool();
+
+   ThreadPool(const ThreadPool&) = delete;
+   ThreadPool(const ThreadPool&&) = delete;
+   ThreadPool& operator=(const ThreadPool&) = delete;
+   ThreadPool& operator=(const ThreadPool&&) = delete;
+
+   [[nodiscard]] int getThreadNum() const { return static_cast<int>(Workers.size()) + 1; }
+   // calls function( i ) for every i in [0, task_num), and returns when all of them are done.
+   void run(int task_num, const std::function<void(int)>& function);
+   // calls function( begin, end ) for consecutive blocks of [0, size), each of which has at most block_size indices.
+   void runInBlocks(int size, int block_size, const std::function<void(int, int)>& function);
+
+private:
+   bool Stop;
+   int TaskNum;
+   int Generation;
+   int BusyWorkerNum;
+   std::atomic<int> NextTask;
+   const std::function<void(int)>* Function;
+   std::mutex Mutex;
+   std::condition_variable WorkCondition;
+   std::condition_variable DoneCondition;
+   std::vector<std::thread> Workers;
+
+   void work();
+   void runTasks();
+};
@@ -33,20 +33,73 @@ struct Disk
    int RightChildIndex;
    float AreaOverPi;
    float Accessibility;
+   int FaceBegin;
+   int FaceCount;
    vec3 Centroid;
+   float Radius;
    vec3 Normal;
+   float ConeSine;
    vec3 BentNormal;
 };
 
+// the hot/cold layout, where the children of an emitter are next to each other from its child.
+// an emitter without a child is a leaf. the normal is octahedral. (OcclusionTree::EmitterForShader)
+struct Emitter
+{
+   vec3 Centroid;
+   float AreaOverPi;
+   uint Normal;
+   int NextIndex;
+   int ChildIndex;
+   uint RadiusAndCone;
+};
+
+// the emitter of the quantized precision. (OcclusionTree::QuantizedEmitterForShader)
+struct QuantizedEmitter
+{
+   uint CentroidXY;
+   uint CentroidZAndArea;
+   uint Normal;
+   int NextIndex;
+   int ChildIndex;
+   uint RadiusAndCone;
+};
+
+// the bounding box and the area scale of a block of emitters. (Quantizer::Frame)
+struct QuantizationFrame
+{
+   vec3 Origin;
+   float AreaScale;
+   vec3 Extent;
+};
+
+struct Receiver
+{
+   vec3 BentNormal;
+   float Accessibility;
+};
+
 layout (binding = 0, std430) buffer InDisks { Disk in_disks[]; };
 layout (binding = 1, std430) buffer Indices { int indices[]; };
-layout (binding = 2, std430) buffer Vertices { vec3 vertices[]; };
-
+// the vertices are tightly packed glm::vec3, so they are read as floats. std430 would give a vec3 array 16 bytes each.
+layout (binding = 2, std430) buffer Vertices { float vertices[]; };
+layout (binding = 3, std430) buffer Emitters { Emitter emitters[]; };
+layout (binding = 4, std430) buffer InReceivers { Receiver in_receivers[]; };
+layout (binding = 5, std430) buffer QuantizedEmitters { QuantizedEmitter quantized_emitters[]; };
+// the first face and the number of faces of a leaf in the hot/cold layout. (OcclusionTree::Disk::FaceBegin)
+layout (binding = 6, std430) buffer FaceRanges { ivec2 face_ranges[]; };
+// the frame of the index-th emitter is quantization_frames[index >> QuantizationFrameSizeLog2].
+layout (binding = 7, std430) buffer QuantizationFrames { QuantizationFrame quantization_frames[]; };
+
+uniform int HotColdLayout;
+uniform int QuantizedLayout;
 uniform int Robust;
 uniform int UseBentNormal;
 uniform int RootIndex;
 uniform float ProximityTolerance;
 uniform float DistanceAttenuation;
+uniform float MaxOcclusionDistance;
+uniform int UseNormalCones;
 uniform float TriangleAttenuation;
 
 uniform int UseLight;
@@ -68,6 +121,8 @@ layout (location = 0) out vec4 final_color;
 const float zero = 0.0f;
 const float one = 1.0f;
 const float epsilon = 1e-16f;
+// the same as Quantizer::FrameSizeLog2.
+const int QuantizationFrameSizeLog2 = 8;
 const float half_pi = 1.57079632679489661923132169163975144f;
 
 bool IsPointLight(in vec4 light_position)
@@ -138,6 +193,91 @@ vec4 calculateLightingEquation(in vec3 normal)
    return color;
 }
 
+// the normal is stored as two 16-bit snorms on the unfolded octahedron. (Quantizer::getOctahedralNormal)
+vec3 getNormal(in uint octahedral_normal)
+{
+   vec2 p = unpackSnorm2x16( octahedral_normal );
+   vec3 n = vec3(p, one - abs( p.x ) - abs( p.y ));
+   float t = max( -n.z, zero );
+   n.x += n.x >= zero ? -t : t;
+   n.y += n.y >= zero ? -t : t;
+   return normalize( n );
+}
+
+// the position is stored as 16-bit unorms in the bounding box of the frame of the disk, and the scaled area
+// as fp16. (Quantizer::getPositionAndArea)
+void getPositionAndArea(out vec3 position, out float area, in uint xy, in uint z_and_area, in int index)
+{
+   QuantizationFrame frame = quantization_frames[index >> QuantizationFrameSizeLog2];
+   position = frame.Origin + vec3(unpackUnorm2x16( xy ), unpackUnorm2x16( z_and_area ).x) * frame.Extent;
+   area = unpackHalf2x16( z_and_area ).y / frame.AreaScale;
+}
+
+// the radius and the sine of the normal cone are stored as fp16. (Quantizer::getRadiusAndCone)
+void getRadiusAndCone(out float radius, out float cone_sine, in uint radius_and_cone)
+{
+   vec2 unpacked = unpackHalf2x16( radius_and_cone );
+   radius = unpacked.x;
+   cone_sine = unpacked.y;
+}
+
+Disk getDisk(in int index)
+{
+   if (!bool(HotColdLayout)) return in_disks[index];
+
+   Disk disk;
+   disk.ParentIndex = -1;
+   if (bool(QuantizedLayout)) {
+      QuantizedEmitter emitter = quantized_emitters[index];
+      disk.NextIndex = emitter.NextIndex;
+      disk.LeftChildIndex = emitter.ChildIndex;
+      getPositionAndArea( disk.Centroid, disk.AreaOverPi, emitter.CentroidXY, emitter.CentroidZAndArea, index );
+      disk.Normal = getNormal( emitter.Normal );
+      getRadiusAndCone( disk.Radius, disk.ConeSine, emitter.RadiusAndCone );
+   }
+   else {
+      Emitter emitter = emitters[index];
+      disk.NextIndex = emitter.NextIndex;
+      disk.LeftChildIndex = emitter.ChildIndex;
+      disk.AreaOverPi = emitter.AreaOverPi;
+      disk.Centroid = emitter.Centroid;
+      disk.Normal = getNormal( emitter.Normal );
+      getRadiusAndCone( disk.Radius, disk.ConeSine, emitter.RadiusAndCone );
+   }
+   disk.RightChildIndex = -1;
+   disk.FaceBegin = -1;
+   disk.FaceCount = 0;
+   disk.Accessibility = in_receivers[index].Accessibility;
+   disk.BentNormal = vec3(zero);
+   return disk;
+}
+
+// the emitter and its subtree are culled if their bounding sphere is farther than MaxOcclusionDistance.
+bool isBeyondOcclusionDistance(in Disk emitter, in float squared_distance)
+{
+   float reach = MaxOcclusionDistance + emitter.Radius;
+   return squared_distance > reach * reach;
+}
+
+// the subtree of the emitter casts no shadow if its bounding sphere is below the tangent plane of the receiver, or if
+// the receiver is behind every disk and triangle in it, whose normals are in the cone of ConeSine around the normal.
+// v is the vector from the receiver to the centroid of the emitter.
+bool isCulledByNormalCone(in Disk emitter, in vec3 v, in float squared_distance, in vec3 receiver_normal)
+{
+   if (!bool(UseNormalCones)) return false;
+
+   if (dot( receiver_normal, v ) < -emitter.Radius) return true;
+   if (emitter.ConeSine >= one || squared_distance <= emitter.Radius * emitter.Radius) return false;
+
+   // the cone widened by the angle of the sphere has to be narrower than a half space.
+   float distance = sqrt( squared_distance );
+   float sphere_sine = emitter.Radius / distance;
+   float sphere_cosine = sqrt( one - sphere_sine * sphere_sine );
+   float cone_cosine = sqrt( one - emitter.ConeSine * emitter.ConeSine );
+   if (cone_cosine * sphere_cosine <= emitter.ConeSine * sphere_sine) return false;
+   return dot( emitter.Normal, v ) > distance * (emitter.ConeSine * sphere_cosine + cone_cosine * sphere_sine);
+}
+
 float getShadowApproximation(
    in vec3 v,
    in float squared_distance,
@@ -187,8 +327,8 @@ void getVisiblePoints(
       dot( receiver_normal, emitter_v2 ) - d,
    };
    if (abs( signed_distances[0] ) <= 1e-6f) signed_distances[0] = zero;
-   if (abs( signed_distances[1] ) <= 1e-6f) signed_distances[0] = zero;
-   if (abs( signed_distances[2] ) <= 1e-6f) signed_distances[0] = zero;
+   if (abs( signed_distances[1] ) <= 1e-6f) signed_distances[1] = zero;
+   if (abs( signed_distances[2] ) <= 1e-6f) signed_distances[2] = zero;
 
    if (signed_distances[0] > zero) {
       if (signed_distances[1] > zero) {
@@ -344,6 +484,24 @@ void getVisiblePoints(
    }
 }
 
+// the angle of the edge from a to b, seen from the receiver, projected onto the receiver normal.
+// an edge from the receiver itself or between repeated points subtends no angle, and normalize() of a zero vector is
+// undefined, so such an edge adds nothing. (RobustOcclusionBaker::calculateFormFactor)
+float getEdgeFactor(in vec3 a, in vec3 b, in vec3 receiver_normal)
+{
+   float a_length = length( a );
+   float b_length = length( b );
+   if (a_length <= zero || b_length <= zero) return zero;
+
+   vec3 ra = a / a_length;
+   vec3 rb = b / b_length;
+   vec3 g = cross( rb, ra );
+   float g_length = length( g );
+   if (g_length <= zero) return zero;
+
+   return acos( clamp( dot( ra, rb ), -one, one ) ) * clamp( dot( receiver_normal, g / g_length ), -one, one );
+}
+
 float calculateFormFactor(
    in vec3 q0,
    in vec3 q1,
@@ -354,31 +512,38 @@ float calculateFormFactor(
 )
 {
    const float one_over_two_pi = 0.159154943091895335768883763372514362f;
-   vec3 r0 = normalize( q0 - receiver_position );
-   vec3 r1 = normalize( q1 - receiver_position );
-   vec3 r2 = normalize( q2 - receiver_position );
-   vec3 r3 = normalize( q3 - receiver_position );
-   vec3 g0 = normalize( cross( r1, r0 ) );
-   vec3 g1 = normalize( cross( r2, r1 ) );
-   vec3 g2 = normalize( cross( r3, r2 ) );
-   vec3 g3 = normalize( cross( r0, r3 ) );
-   float factor = acos( clamp( dot( r0, r1 ), -one, one ) ) * clamp( dot( receiver_normal, g0 ), -one, one );
-   factor += acos( clamp( dot( r1, r2 ), -one, one ) ) * clamp( dot( receiver_normal, g1 ), -one, one );
-   factor += acos( clamp( dot( r2, r3 ), -one, one ) ) * clamp( dot( receiver_normal, g2 ), -one, one );
-   factor += acos( clamp( dot( r3, r0 ), -one, one ) ) * clamp( dot( receiver_normal, g3 ), -one, one );
+   vec3 r0 = q0 - receiver_position;
+   vec3 r1 = q1 - receiver_position;
+   vec3 r2 = q2 - receiver_position;
+   vec3 r3 = q3 - receiver_position;
+   float factor = getEdgeFactor( r0, r1, receiver_normal );
+   factor += getEdgeFactor( r1, r2, receiver_normal );
+   factor += getEdgeFactor( r2, r3, receiver_normal );
+   factor += getEdgeFactor( r3, r0, receiver_normal );
    factor *= one_over_two_pi;
    return max( factor, zero );
 }
 
+// the faces are in the order of the leaves, so a leaf disk has the faces from FaceBegin to FaceBegin + FaceCount.
+ivec2 getFaceRange(in int index, in Disk disk)
+{
+   return bool(HotColdLayout) ? face_ranges[index] : ivec2(disk.FaceBegin, disk.FaceCount);
+}
+
+vec3 getVertex(in int index)
+{
+   return vec3(vertices[3 * index], vertices[3 * index + 1], vertices[3 * index + 2]);
+}
+
 float getFormFactor(in vec3 receiver_position, in vec3 receiver_normal, in int index)
 {
    int face_index = 3 * index;
    int i0 = indices[face_index];
    int i1 = indices[face_index + 1];
    int i2 = indices[face_index + 2];
-   vec3 v0 = vertices[i0];
-   vec3 v1 = vertices[i1];
-   vec3 v2 = vertices[i2];
+   vec3 v0 = getVertex( i0 );
+   vec3 v1 = getVertex( i1 );
+   vec3 v2 = getVertex( i2 );
    vec3 q0, q1, q2, q3;
    getVisiblePoints( q0, q1, q2, q3, receiver_position, receiver_normal, v0, v1, v2 );
    return calculateFormFactor( q0, q1, q2, q3, receiver_position, receiver_normal );
@@ -390,23 +555,26 @@ float calculateOcclusion(out vec3 bent_normal)
    int emitter_index = RootIndex;
    float total_shadow = zero;
    while (emitter_index >= 0) {
-      vec3 emitter_position = in_disks[emitter_index].Centroid;
-      vec3 emitter_normal = in_disks[emitter_index].Normal;
-      float emitter_area = in_disks[emitter_index].AreaOverPi;
-      vec3 v = emitter_position - receiver_position;
+      Disk emitter = getDisk( emitter_index );
+      vec3 v = emitter.Centroid - receiver_position;
       float squared_distance = dot( v, v ) + epsilon;
-      if (in_disks[emitter_index].LeftChildIndex >= 0 && squared_distance < emitter_area * ProximityTolerance) {
-         emitter_index = in_disks[emitter_index].LeftChildIndex;
+      if (isBeyondOcclusionDistance( emitter, squared_distance )) {
+         emitter_index = emitter.NextIndex;
+         continue;
+      }
+      if (emitter.LeftChildIndex >= 0 && squared_distance < emitter.AreaOverPi * ProximityTolerance) {
+         bool culled = isCulledByNormalCone( emitter, v, squared_distance, receiver_normal );
+         emitter_index = culled ? emitter.NextIndex : emitter.LeftChildIndex;
          continue;
       }
       v *= inversesqrt( squared_distance );
-      float shadow = getShadowApproximation( v, squared_distance, receiver_normal, emitter_normal, emitter_area );
-      shadow *= in_disks[emitter_index].Accessibility;
+      float shadow = getShadowApproximation( v, squared_distance, receiver_normal, emitter.Normal, emitter.AreaOverPi );
+      shadow *= emitter.Accessibility;
       shadow /= (one + DistanceAttenuation * sqrt( squared_distance ));
 
       total_shadow += shadow;
       bent_normal -= shadow * v;
-      emitter_index = in_disks[emitter_index].NextIndex;
+      emitter_index = emitter.NextIndex;
    }
    bent_normal = normalize( bent_normal );
    return clamp( one - total_shadow, zero, one );
@@ -423,18 +591,29 @@ float calculateRobustOcclusion(out vec3 bent_normal)
    float parent_weight = zero;
    const float zone_radius = 0.1f;
    while (emitter_index >= 0) {
-      vec3 emitter_position = in_disks[emitter_index].Centroid;
-      vec3 emitter_normal = in_disks[emitter_index].Normal;
-      float emitter_area = in_disks[emitter_index].AreaOverPi;
-      vec3 v = emitter_position - receiver_position;
+      Disk emitter = getDisk( emitter_index );
+      vec3 emitter_normal = emitter.Normal;
+      float emitter_area = emitter.AreaOverPi;
+      vec3 v = emitter.Centroid - receiver_position;
       float squared_distance = dot( v, v ) + epsilon;
+      if (isBeyondOcclusionDistance( emitter, squared_distance )) {
+         emitter_index = emitter.NextIndex;
+         if (emitter_index == parent_next) parent_weight = zero;
+         continue;
+      }
       v *= inversesqrt( squared_distance );
       float close = ProximityTolerance * emitter_area;
-      if (in_disks[emitter_index].LeftChildIndex >= 0 && squared_distance < close * (one + zone_radius)) {
-         parent_next = in_disks[emitter_index].NextIndex;
-         emitter_index = in_disks[emitter_index].LeftChildIndex;
+      if (emitter.LeftChildIndex >= 0 && squared_distance < close * (one + zone_radius)) {
+         if (isCulledByNormalCone( emitter, v * sqrt( squared_distance ), squared_distance, receiver_normal )) {
+            // the same as visiting the subtree, where every shadow is zero, and whose end also ends the parent zone.
+            emitter_index = emitter.NextIndex;
+            parent_weight = zero;
+            continue;
+         }
+         parent_next = emitter.NextIndex;
+         emitter_index = emitter.LeftChildIndex;
          float shadow = getShadowApproximation( v, squared_distance, receiver_normal, emitter_normal, emitter_area );
-         shadow *= in_disks[emitter_index].Accessibility;
+         shadow *= getDisk( emitter_index ).Accessibility;
          shadow /= (one + DistanceAttenuation * sqrt( squared_distance ));
          parent_shadow = shadow;
          parent_area = emitter_area;
@@ -443,26 +622,29 @@ float calculateRobustOcclusion(out vec3 bent_normal)
       }
       else {
          float shadow = zero;
-         if (in_disks[emitter_index].LeftChildIndex < 0) {
+         if (emitter.LeftChildIndex < 0) {
             if (dot( emitter_normal, -v ) >= zero) {
-               shadow = getFormFactor( receiver_position, receiver_normal, 0 );
+               ivec2 faces = getFaceRange( emitter_index, emitter );
+               for (int f = faces.x; f < faces.x + faces.y; ++f) {
+                  shadow += getFormFactor( receiver_position, receiver_normal, f );
+               }
 
                // with low TriangleAttenuation, small features like creases and cracks are emphasized.
                // with high TriangleAttenuation, the influence of far away (probably invisible) triangles is lessened.
-               shadow *= pow( in_disks[emitter_index].Accessibility, TriangleAttenuation );
+               shadow *= pow( emitter.Accessibility, TriangleAttenuation );
 
                shadow /= (one + DistanceAttenuation * sqrt( squared_distance ));
             }
          }
          else {
             shadow = getShadowApproximation( v, squared_distance, receiver_normal, emitter_normal, emitter_area );
-            shadow *= in_disks[emitter_index].Accessibility;
+            shadow *= emitter.Accessibility;
             shadow /= (one + DistanceAttenuation * sqrt( squared_distance ));
          }
 
          bent_normal -= shadow * v;
          total_shadow += mix( shadow, parent_shadow * emitter_area / parent_area, parent_weight );
-         emitter_index = in_disks[emitter_index].NextIndex;
+         emitter_index = emitter.NextIndex;
          if (emitter_index == parent_next) parent_weight = zero;
       }
    }
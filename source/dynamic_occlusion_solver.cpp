@@ -0,0 +1,212 @@
+#include "dynamic_occlusion_solver.h"
+
+DynamicOcclusionSolver::DynamicOcclusionSolver(int thread_num) :
+   UseNormalCones( true ), UsePackets( true ), SelfSquaredDistance( 0.0f ), Pool( thread_num )
+{
+}
+
+void DynamicOcclusionSolver::setEmitters(const SurfaceElement& surface, Quantizer::PRECISION precision)
+{
+   std::vector<SurfaceElement::ElementForShader> elements;
+   SelfSquaredDistance = 0.0f;
+   if (precision == Quantizer::PRECISION::QUANTIZED) {
+      std::vector<SurfaceElement::QuantizedElementForShader> quantized_elements;
+      surface.getQuantizedElements( quantized_elements );
+      elements.reserve( quantized_elements.size() );
+      for (size_t i = 0; i < quantized_elements.size(); ++i) {
+         elements.emplace_back( surface.getElementFromQuantized( quantized_elements[i], static_cast<int>(i) ) );
+      }
+
+      // the leaf of the receiver itself is off by up to one quantization cell.
+      SelfSquaredDistance = surface.getSelfSquaredDistance();
+   }
+   else elements = surface.getElements();
+
+   Emitters.resize( elements.size() );
+   for (size_t i = 0; i < elements.size(); ++i) {
+      Emitter& emitter = Emitters[i];
+      emitter.Position = elements[i].Position;
+      emitter.AreaOverPi = elements[i].AreaOverPi;
+      emitter.Normal = Quantizer::getNormalFromOctahedral( elements[i].Normal );
+      emitter.NextIndex = elements[i].NextIndex;
+      emitter.ChildIndex = elements[i].ChildIndex;
+      Quantizer::getRadiusAndConeFromPacked( emitter.Radius, emitter.ConeSine, elements[i].RadiusAndCone );
+   }
+}
+
+// the same as isCulledByNormalCone() of the shader, where the elements cast no shadow on the receiver in front of them.
+bool DynamicOcclusionSolver::isCulledByNormalCone(
+   const Emitter& emitter,
+   const glm::vec3& v,
+   float squared_distance,
+   const glm::vec3& receiver_normal
+) const
+{
+   return
+      UseNormalCones && OcclusionKernel::isCulledByNormalCone(
+         v, squared_distance, receiver_normal, -emitter.Normal, emitter.Radius, emitter.ConeSine
+      );
+}
+
+int DynamicOcclusionSolver::getCulledMask(
+   const Emitter& emitter,
+   const Vec3Packet& v,
+   const FloatPacket& squared_distance,
+   const Vec3Packet& receiver_normal
+) const
+{
+   if (!UseNormalCones) return 0;
+   return OcclusionKernel::getCulledMask(
+      v, squared_distance, receiver_normal, -emitter.Normal, emitter.Radius, emitter.ConeSine
+   );
+}
+
+void DynamicOcclusionSolver::setReceiver(
+   SurfaceElement::ReceiverForShader& receiver,
+   float total_shadow,
+   const glm::vec3& bent_normal,
+   int phase
+)
+{
+   if (phase == 1) receiver.Accessibility = std::clamp( 1.0f - total_shadow, 0.0f, 1.0f );
+   else {
+      receiver.BentNormal = glm::normalize( bent_normal );
+      receiver.Accessibility =
+         glm::mix( std::clamp( 1.0f - total_shadow, 0.0f, 1.0f ), receiver.Accessibility, 0.4f );
+   }
+}
+
+void DynamicOcclusionSolver::solveReceiver(SurfaceElement::ReceiverForShader& receiver, int phase) const
+{
+   int emitter_index = Emitters.empty() ? -1 : 0;
+   float total_shadow = 0.0f;
+   const float previous_accessibility = receiver.Accessibility;
+   glm::vec3 bent_normal = receiver.Normal;
+   while (emitter_index >= 0) {
+      const Emitter& emitter = Emitters[emitter_index];
+      glm::vec3 v = emitter.Position - receiver.Position;
+      const float squared_distance = glm::dot( v, v ) + 1e-16f;
+      if (emitter.ChildIndex >= 0 && squared_distance < emitter.AreaOverPi * 4.0f) {
+         const bool culled = isCulledByNormalCone( emitter, v, squared_distance, receiver.Normal );
+         emitter_index = culled ? emitter.NextIndex : emitter.ChildIndex;
+         continue;
+      }
+      if (emitter.ChildIndex < 0 && squared_distance < SelfSquaredDistance) {
+         emitter_index = emitter.NextIndex;
+         continue;
+      }
+      v /= std::sqrt( squared_distance );
+      float shadow =
+         OcclusionKernel::getElementShadow( v, squared_distance, receiver.Normal, emitter.Normal, emitter.AreaOverPi );
+
+      // the later phases are modulated by the accessibility of the receiver from the previous phase.
+      if (phase > 1) shadow *= previous_accessibility;
+
+      total_shadow += shadow;
+      bent_normal -= shadow * v;
+      emitter_index = emitter.NextIndex;
+   }
+   setReceiver( receiver, total_shadow, bent_normal, phase );
+}
+
+void DynamicOcclusionSolver::solvePacket(
+   SurfaceElement::ReceiverForShader* receivers,
+   int receiver_num,
+   int phase
+) const
+{
+   // the lanes after receiver_num repeat the last receiver, but they are never active.
+   std::array<const SurfaceElement::ReceiverForShader*, FloatPacket::Width> lanes{};
+   std::array<float, FloatPacket::Width> accessibilities{};
+   for (int i = 0; i < FloatPacket::Width; ++i) {
+      lanes[i] = &receivers[std::min( i, receiver_num - 1 )];
+      accessibilities[i] = lanes[i]->Accessibility;
+   }
+   const Vec3Packet position = Vec3Packet::load( lanes, &SurfaceElement::ReceiverForShader::Position );
+   const Vec3Packet normal = Vec3Packet::load( lanes, &SurfaceElement::ReceiverForShader::Normal );
+   const FloatPacket previous_accessibility = FloatPacket::load( accessibilities.data() );
+   FloatPacket total_shadow(0.0f);
+   Vec3Packet bent_normal = normal;
+   const auto accumulate = [&](int mask, const Emitter& emitter, Vec3Packet v, const FloatPacket& squared_distance)
+   {
+      if (mask == 0) return;
+
+      v = v / FloatPacket::sqrt( squared_distance );
+      FloatPacket shadow =
+         OcclusionKernel::getElementShadow( v, squared_distance, normal, emitter.Normal, emitter.AreaOverPi );
+      if (phase > 1) shadow = shadow * previous_accessibility;
+      total_shadow = FloatPacket::select( mask, total_shadow + shadow, total_shadow );
+      bent_normal = Vec3Packet::select( mask, bent_normal - shadow * v, bent_normal );
+   };
+
+   // the packet descends if any lane descends. the other lanes wait until the packet leaves the subtree, which is
+   // when it reaches the next emitter of the subtree root, so every lane visits the emitters as its scalar traversal.
+   int active = (1 << receiver_num) - 1;
+   int waiting = 0;
+   std::array<int, FloatPacket::Width> resume_indices{};
+   int emitter_index = Emitters.empty() ? -1 : 0;
+   while (emitter_index >= 0) {
+      for (int i = 0; waiting != 0 && i < FloatPacket::Width; ++i) {
+         if ((waiting >> i & 1) != 0 && resume_indices[i] == emitter_index) {
+            active |= 1 << i;
+            waiting &= ~(1 << i);
+         }
+      }
+      const Emitter& emitter = Emitters[emitter_index];
+      if (active == 0) {
+         emitter_index = emitter.NextIndex;
+         continue;
+      }
+
+      const Vec3Packet v = Vec3Packet(emitter.Position) - position;
+      const FloatPacket squared_distance = Vec3Packet::dot( v, v ) + FloatPacket(1e-16f);
+      int shaded = active;
+      if (emitter.ChildIndex >= 0) {
+         const int close = active & FloatPacket::less( squared_distance, FloatPacket(emitter.AreaOverPi * 4.0f) );
+         if (close != 0) {
+            shaded = active & ~close;
+            const int descending = close & ~getCulledMask( emitter, v, squared_distance, normal );
+            if (descending != 0) {
+               accumulate( shaded, emitter, v, squared_distance );
+               const int skipping = active & ~descending;
+               for (int i = 0; i < FloatPacket::Width; ++i) {
+                  if ((skipping >> i & 1) != 0) resume_indices[i] = emitter.NextIndex;
+               }
+               waiting |= skipping;
+               active = descending;
+               emitter_index = emitter.ChildIndex;
+               continue;
+            }
+         }
+      }
+      else shaded = active & ~FloatPacket::less( squared_distance, FloatPacket(SelfSquaredDistance) );
+      accumulate( shaded, emitter, v, squared_distance );
+      emitter_index = emitter.NextIndex;
+   }
+
+   std::array<float, FloatPacket::Width> total_shadows{};
+   std::array<glm::vec3, FloatPacket::Width> bent_normals{};
+   total_shadow.store( total_shadows.data() );
+   bent_normal.store( bent_normals );
+   for (int i = 0; i < receiver_num; ++i) setReceiver( receivers[i], total_shadows[i], bent_normals[i], phase );
+}
+
+void DynamicOcclusionSolver::solvePhase(std::vector<SurfaceElement::ReceiverForShader>& receivers, int phase)
+{
+   Pool.runInBlocks(
+      static_cast<int>(receivers.size()), BlockSize, [&](int begin, int end)
+      {
+         if (UsePackets) {
+            for (int i = begin; i < end; i += FloatPacket::Width) {
+               solvePacket( &receivers[i], std::min( FloatPacket::Width, end - i ), phase );
+            }
+         }
+         else for (int i = begin; i < end; ++i) solveReceiver( receivers[i], phase );
+      }
+   );
+}
+
+void DynamicOcclusionSolver::solve(std::vector<SurfaceElement::ReceiverForShader>& receivers, int pass_num)
+{
+   for (int phase = 1; phase <= pass_num; ++phase) solvePhase( receivers, phase );
+}
@@ -0,0 +1,222 @@
+#include "high_quality_occlusion_solver.h"
+
+HighQualityOcclusionSolver::HighQualityOcclusionSolver(int thread_num) :
+   UseNormalCones( true ), UsePackets( true ), RootIndex( OcclusionTree::NullIndex ), TargetBufferIndex( 0 ),
+   ProximityTolerance( 0.0f ), DistanceAttenuation( 0.0f ), MaxOcclusionDistance( std::numeric_limits<float>::max() ),
+   Pool( thread_num )
+{
+}
+
+void HighQualityOcclusionSolver::setDisks(const OcclusionTree& tree)
+{
+   RootIndex = tree.getRootIndex();
+   ProximityTolerance = tree.getProximityTolerance();
+   DistanceAttenuation = tree.getDistanceAttenuation();
+   MaxOcclusionDistance = tree.getMaxOcclusionDistance();
+   TargetBufferIndex = 0;
+   for (auto& disks : DisksBuffers) disks = tree.getDisks();
+}
+
+// the same as isCulledByNormalCone() of the shader, where the disks cast no shadow on the receiver behind them.
+bool HighQualityOcclusionSolver::isCulledByNormalCone(
+   const OcclusionTree::Disk& emitter,
+   const glm::vec3& v,
+   float squared_distance,
+   const glm::vec3& receiver_normal
+) const
+{
+   return
+      UseNormalCones && OcclusionKernel::isCulledByNormalCone(
+         v, squared_distance, receiver_normal, emitter.Normal, emitter.Radius, emitter.ConeSine
+      );
+}
+
+int HighQualityOcclusionSolver::getCulledMask(
+   const OcclusionTree::Disk& emitter,
+   const Vec3Packet& v,
+   const FloatPacket& squared_distance,
+   const Vec3Packet& receiver_normal
+) const
+{
+   if (!UseNormalCones) return 0;
+   return OcclusionKernel::getCulledMask(
+      v, squared_distance, receiver_normal, emitter.Normal, emitter.Radius, emitter.ConeSine
+   );
+}
+
+void HighQualityOcclusionSolver::setReceiver(
+   OcclusionTree::Disk& out_receiver,
+   const OcclusionTree::Disk& receiver,
+   float total_shadow,
+   const glm::vec3& bent_normal,
+   bool last_phase
+)
+{
+   out_receiver.BentNormal = glm::normalize( bent_normal );
+
+   float accessibility = std::clamp( 1.0f - total_shadow, 0.0f, 1.0f );
+   if (last_phase) {
+      const float previous_accessibility = receiver.Accessibility;
+      accessibility = glm::mix(
+         std::min( previous_accessibility, accessibility ), std::max( previous_accessibility, accessibility ), 0.3f
+      );
+   }
+   out_receiver.Accessibility = accessibility;
+}
+
+void HighQualityOcclusionSolver::solveReceiver(
+   OcclusionTree::Disk& out_receiver,
+   const OcclusionTree::Disk& receiver,
+   const std::vector<OcclusionTree::Disk>& in_disks,
+   bool first_phase,
+   bool last_phase
+) const
+{
+   int emitter_index = RootIndex;
+   float total_shadow = 0.0f;
+   glm::vec3 bent_normal = receiver.Normal;
+   while (emitter_index >= 0) {
+      const OcclusionTree::Disk& emitter = in_disks[emitter_index];
+      glm::vec3 v = emitter.Centroid - receiver.Centroid;
+      const float squared_distance = glm::dot( v, v ) + 1e-16f;
+      const float reach = MaxOcclusionDistance + emitter.Radius;
+      if (squared_distance > reach * reach) {
+         emitter_index = emitter.NextIndex;
+         continue;
+      }
+      if (emitter.LeftChildIndex >= 0 && squared_distance < emitter.AreaOverPi * ProximityTolerance) {
+         const bool culled = isCulledByNormalCone( emitter, v, squared_distance, receiver.Normal );
+         emitter_index = culled ? emitter.NextIndex : emitter.LeftChildIndex;
+         continue;
+      }
+      const float distance = std::sqrt( squared_distance );
+      v /= distance;
+      float shadow =
+         OcclusionKernel::getDiskShadow( v, squared_distance, receiver.Normal, emitter.Normal, emitter.AreaOverPi );
+      if (!first_phase) shadow *= emitter.Accessibility;
+      shadow /= 1.0f + DistanceAttenuation * distance;
+
+      total_shadow += shadow;
+      bent_normal -= shadow * v;
+      emitter_index = emitter.NextIndex;
+   }
+   setReceiver( out_receiver, receiver, total_shadow, bent_normal, last_phase );
+}
+
+void HighQualityOcclusionSolver::solvePacket(
+   std::vector<OcclusionTree::Disk>& out_disks,
+   const std::vector<OcclusionTree::Disk>& in_disks,
+   int begin,
+   int receiver_num,
+   bool first_phase,
+   bool last_phase
+) const
+{
+   // the lanes after receiver_num repeat the last receiver, but they are never active.
+   std::array<const OcclusionTree::Disk*, FloatPacket::Width> lanes{};
+   for (int i = 0; i < FloatPacket::Width; ++i) lanes[i] = &in_disks[begin + std::min( i, receiver_num - 1 )];
+   const Vec3Packet position = Vec3Packet::load( lanes, &OcclusionTree::Disk::Centroid );
+   const Vec3Packet normal = Vec3Packet::load( lanes, &OcclusionTree::Disk::Normal );
+   FloatPacket total_shadow(0.0f);
+   Vec3Packet bent_normal = normal;
+   const auto accumulate = [&](
+      int mask,
+      const OcclusionTree::Disk& emitter,
+      Vec3Packet v,
+      const FloatPacket& squared_distance
+   )
+   {
+      if (mask == 0) return;
+
+      const FloatPacket distance = FloatPacket::sqrt( squared_distance );
+      v = v / distance;
+      FloatPacket shadow =
+         OcclusionKernel::getDiskShadow( v, squared_distance, normal, emitter.Normal, emitter.AreaOverPi );
+      if (!first_phase) shadow = shadow * FloatPacket(emitter.Accessibility);
+      shadow = shadow / (FloatPacket(1.0f) + FloatPacket(DistanceAttenuation) * distance);
+
+      total_shadow = FloatPacket::select( mask, total_shadow + shadow, total_shadow );
+      bent_normal = Vec3Packet::select( mask, bent_normal - shadow * v, bent_normal );
+   };
+
+   // the packet descends if any lane descends. the other lanes wait until the packet leaves the subtree, which is
+   // when it reaches the next emitter of the subtree root, so every lane visits the emitters as its scalar traversal.
+   int active = (1 << receiver_num) - 1;
+   int waiting = 0;
+   std::array<int, FloatPacket::Width> resume_indices{};
+   int emitter_index = RootIndex;
+   while (emitter_index >= 0) {
+      for (int i = 0; waiting != 0 && i < FloatPacket::Width; ++i) {
+         if ((waiting >> i & 1) != 0 && resume_indices[i] == emitter_index) {
+            active |= 1 << i;
+            waiting &= ~(1 << i);
+         }
+      }
+      const OcclusionTree::Disk& emitter = in_disks[emitter_index];
+      if (active == 0) {
+         emitter_index = emitter.NextIndex;
+         continue;
+      }
+
+      const Vec3Packet v = Vec3Packet(emitter.Centroid) - position;
+      const FloatPacket squared_distance = Vec3Packet::dot( v, v ) + FloatPacket(1e-16f);
+      const float reach = MaxOcclusionDistance + emitter.Radius;
+      int shaded = active & ~FloatPacket::greater( squared_distance, FloatPacket(reach * reach) );
+      if (emitter.LeftChildIndex >= 0) {
+         const int close =
+            shaded & FloatPacket::less( squared_distance, FloatPacket(emitter.AreaOverPi * ProximityTolerance) );
+         if (close != 0) {
+            shaded &= ~close;
+            const int descending = close & ~getCulledMask( emitter, v, squared_distance, normal );
+            if (descending != 0) {
+               accumulate( shaded, emitter, v, squared_distance );
+               const int skipping = active & ~descending;
+               for (int i = 0; i < FloatPacket::Width; ++i) {
+                  if ((skipping >> i & 1) != 0) resume_indices[i] = emitter.NextIndex;
+               }
+               waiting |= skipping;
+               active = descending;
+               emitter_index = emitter.LeftChildIndex;
+               continue;
+            }
+         }
+      }
+      accumulate( shaded, emitter, v, squared_distance );
+      emitter_index = emitter.NextIndex;
+   }
+
+   std::array<float, FloatPacket::Width> total_shadows{};
+   std::array<glm::vec3, FloatPacket::Width> bent_normals{};
+   total_shadow.store( total_shadows.data() );
+   bent_normal.store( bent_normals );
+   for (int i = 0; i < receiver_num; ++i) {
+      setReceiver( out_disks[begin + i], in_disks[begin + i], total_shadows[i], bent_normals[i], last_phase );
+   }
+}
+
+void HighQualityOcclusionSolver::solvePhase(bool first_phase, bool last_phase)
+{
+   const std::vector<OcclusionTree::Disk>& in_disks = DisksBuffers[TargetBufferIndex];
+   std::vector<OcclusionTree::Disk>& out_disks = DisksBuffers[TargetBufferIndex ^ 1];
+   Pool.runInBlocks(
+      static_cast<int>(in_disks.size()), TileSize, [&](int begin, int end)
+      {
+         if (UsePackets) {
+            for (int i = begin; i < end; i += FloatPacket::Width) {
+               solvePacket( out_disks, in_disks, i, std::min( FloatPacket::Width, end - i ), first_phase, last_phase );
+            }
+         }
+         else {
+            for (int i = begin; i < end; ++i) {
+               solveReceiver( out_disks[i], in_disks[i], in_disks, first_phase, last_phase );
+            }
+         }
+      }
+   );
+   TargetBufferIndex ^= 1;
+}
+
+void HighQualityOcclusionSolver::solve(int pass_num)
+{
+   for (int i = 1; i <= pass_num - 1; ++i) solvePhase( i == 1, i == pass_num - 1 );
+}
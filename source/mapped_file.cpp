@@ -0,0 +1,105 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() :
+   Data( nullptr ), Size( 0 )
+#ifdef _WIN32
+   , FileHandle( INVALID_HANDLE_VALUE ), MappingHandle( nullptr )
+#endif
+{
+}
+
+MappedFile::MappedFile(const std::string& file_path) : MappedFile()
+{
+   open( file_path );
+}
+
+MappedFile::~MappedFile()
+{
+   close();
+}
+
+#ifdef _WIN32
+bool MappedFile::open(const std::string& file_path)
+{
+   close();
+
+   FileHandle = CreateFileA(
+      file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr
+   );
+   if (FileHandle == INVALID_HANDLE_VALUE) return false;
+
+   LARGE_INTEGER file_size;
+   if (!GetFileSizeEx( FileHandle, &file_size ) || file_size.QuadPart == 0) {
+      close();
+      return false;
+   }
+
+   MappingHandle = CreateFileMappingA( FileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr );
+   if (MappingHandle == nullptr) {
+      close();
+      return false;
+   }
+
+   Data = static_cast<const char*>(MapViewOfFile( MappingHandle, FILE_MAP_READ, 0, 0, 0 ));
+   if (Data == nullptr) {
+      close();
+      return false;
+   }
+   Size = static_cast<size_t>(file_size.QuadPart);
+   return true;
+}
+
+void MappedFile::close()
+{
+   if (Data != nullptr) UnmapViewOfFile( Data );
+   if (MappingHandle != nullptr) CloseHandle( MappingHandle );
+   if (FileHandle != INVALID_HANDLE_VALUE) CloseHandle( FileHandle );
+   Data = nullptr;
+   Size = 0;
+   MappingHandle = nullptr;
+   FileHandle = INVALID_HANDLE_VALUE;
+}
+#else
+bool MappedFile::open(const std::string& file_path)
+{
+   close();
+
+   const int file = ::open( file_path.c_str(), O_RDONLY );
+   if (file < 0) return false;
+
+   struct stat status{};
+   if (fstat( file, &status ) != 0 || status.st_size <= 0) {
+      ::close( file );
+      return false;
+   }
+
+   // the mapping keeps its own reference to the file, so the descriptor is not needed afterwards.
+   const auto size = static_cast<size_t>(status.st_size);
+   void* data = mmap( nullptr, size, PROT_READ, MAP_PRIVATE, file, 0 );
+   ::close( file );
+   if (data == MAP_FAILED) return false;
+
+   madvise( data, size, MADV_SEQUENTIAL );
+   Data = static_cast<const char*>(data);
+   Size = size;
+   return true;
+}
+
+void MappedFile::close()
+{
+   if (Data != nullptr) munmap( const_cast<char*>(Data), Size );
+   Data = nullptr;
+   Size = 0;
+}
+#endif
@@ -0,0 +1,156 @@
+#include "mesh_cache.h"
+
+std::string MeshCache::getCacheFilePath(const std::string& obj_file_path, const std::string& extension)
+{
+   std::filesystem::path path(obj_file_path);
+   path.replace_extension( extension );
+   return path.string();
+}
+
+uint64_t MeshCache::getHash(const void* data, size_t size, uint64_t hash)
+{
+   // 64-bit FNV-1a
+   const auto* bytes = static_cast<const uint8_t*>(data);
+   for (size_t i = 0; i < size; ++i) {
+      hash ^= bytes[i];
+      hash *= HashPrime;
+   }
+   return hash;
+}
+
+void MeshCache::commitTemporaryFile(const std::string& file_path)
+{
+   const std::string temporary_file_path = getTemporaryFilePath( file_path );
+   std::error_code error;
+   std::filesystem::rename( temporary_file_path, file_path, error );
+   if (error) std::filesystem::remove( temporary_file_path, error );
+}
+
+bool MeshCache::readHeader(Header& header, const char*& ptr, const MappedFile& cache)
+{
+   ptr = cache.data();
+   return readStruct( header, ptr, cache.end() ) && header.Magic == Header().Magic && header.Version == Version;
+}
+
+bool MeshCache::load(ObjectMesh& mesh, const Header& header, const char* ptr, const char* end)
+{
+   mesh.clear();
+   const bool loaded =
+      readArray( mesh.Vertices, header.VertexNum, ptr, end ) &&
+      readArray( mesh.Normals, header.NormalNum, ptr, end ) &&
+      readArray( mesh.Textures, header.TextureNum, ptr, end ) &&
+      readArray( mesh.VertexIndices, header.VertexIndexNum, ptr, end ) &&
+      readArray( mesh.NormalIndices, header.NormalIndexNum, ptr, end ) &&
+      readArray( mesh.TextureIndices, header.TextureIndexNum, ptr, end ) &&
+      readArray( mesh.VertexNormals, header.VertexNum, ptr, end );
+   if (!loaded) {
+      mesh.clear();
+      return false;
+   }
+   mesh.SourceHash = header.SourceHash;
+   return true;
+}
+
+void MeshCache::save(const ObjectMesh& mesh, const Header& header, const std::string& cache_file_path)
+{
+   {
+      std::ofstream file(getTemporaryFilePath( cache_file_path ), std::ios::binary | std::ios::trunc);
+      if (!file.is_open()) return;
+
+      writeStruct( file, header );
+      writeArray( file, mesh.Vertices );
+      writeArray( file, mesh.Normals );
+      writeArray( file, mesh.Textures );
+      writeArray( file, mesh.VertexIndices );
+      writeArray( file, mesh.NormalIndices );
+      writeArray( file, mesh.TextureIndices );
+      writeArray( file, mesh.VertexNormals );
+      if (!file.good()) return;
+   }
+   commitTemporaryFile( cache_file_path );
+}
+
+bool MeshCache::getSourceStatus(uint64_t& source_size, int64_t& source_time, const std::string& obj_file_path)
+{
+   std::error_code error;
+   source_size = static_cast<uint64_t>(std::filesystem::file_size( obj_file_path, error ));
+   if (error) {
+      std::cout << "The object file is not correct.\n";
+      return false;
+   }
+   source_time =
+      static_cast<int64_t>(std::filesystem::last_write_time( obj_file_path, error ).time_since_epoch().count());
+   return true;
+}
+
+bool MeshCache::getSourceHash(uint64_t& source_hash, const std::string& obj_file_path)
+{
+   uint64_t source_size = 0;
+   int64_t source_time = 0;
+   if (!getSourceStatus( source_size, source_time, obj_file_path )) return false;
+
+   Header header;
+   const char* ptr = nullptr;
+   const MappedFile cache(getCacheFilePath( obj_file_path, ".aomesh" ));
+   if (cache.isOpen() && readHeader( header, ptr, cache ) &&
+       header.SourceSize == source_size && header.SourceTime == source_time) {
+      source_hash = header.SourceHash;
+      return true;
+   }
+
+   const MappedFile source(obj_file_path);
+   if (!source.isOpen()) {
+      std::cout << "The object file is not correct.\n";
+      return false;
+   }
+   source_hash = getHash( source.data(), source.size() );
+   return true;
+}
+
+bool MeshCache::read(ObjectMesh& mesh, const std::string& obj_file_path)
+{
+   uint64_t source_size = 0;
+   int64_t source_time = 0;
+   if (!getSourceStatus( source_size, source_time, obj_file_path )) return false;
+
+   Header header;
+   const char* ptr = nullptr;
+   const std::string cache_file_path = getCacheFilePath( obj_file_path, ".aomesh" );
+   MappedFile cache(cache_file_path);
+   const bool has_cache = cache.isOpen() && readHeader( header, ptr, cache ) && header.SourceSize == source_size;
+   if (has_cache && header.SourceTime == source_time && load( mesh, header, ptr, cache.end() )) return true;
+
+   const MappedFile source(obj_file_path);
+   if (!source.isOpen()) {
+      std::cout << "The object file is not correct.\n";
+      return false;
+   }
+
+   // the modification time can change without the contents, e.g. after a checkout.
+   // the cache is rewritten with the new time then, so that the next read does not hash the .obj file again.
+   const uint64_t source_hash = getHash( source.data(), source.size() );
+   if (has_cache && header.SourceHash == source_hash && load( mesh, header, ptr, cache.end() )) {
+      cache.close();
+      header.SourceTime = source_time;
+      save( mesh, header, cache_file_path );
+      return true;
+   }
+   cache.close();
+
+   ObjectFileReader::parse( mesh, source.data(), source.end() );
+   mesh.SourceHash = source_hash;
+   mesh.findVertexNormals();
+
+   Header new_header;
+   new_header.SourceSize = source_size;
+   new_header.SourceTime = source_time;
+   new_header.SourceHash = source_hash;
+   new_header.VertexNum = mesh.Vertices.size();
+   new_header.NormalNum = mesh.Normals.size();
+   new_header.TextureNum = mesh.Textures.size();
+   new_header.VertexIndexNum = mesh.VertexIndices.size();
+   new_header.NormalIndexNum = mesh.NormalIndices.size();
+   new_header.TextureIndexNum = mesh.TextureIndices.size();
+   save( mesh, new_header, cache_file_path );
+   return true;
+}
@@ -298,26 +298,6 @@ void ObjectGL::setObject(
    addTexture( texture_file_path, is_grayscale );
 }
 
-void ObjectGL::findNormals(
-   std::vector<glm::vec3>& normals,
-   const std::vector<glm::vec3>& vertices,
-   const std::vector<GLuint>& vertex_indices
-)
-{
-   normals.resize( vertices.size(), glm::vec3(0.0f) );
-   const auto size = static_cast<int>(vertex_indices.size());
-   for (int i = 0; i < size; i += 3) {
-      const GLuint n0 = vertex_indices[i];
-      const GLuint n1 = vertex_indices[i + 1];
-      const GLuint n2 = vertex_indices[i + 2];
-      const glm::vec3 normal = glm::cross( vertices[n1] - vertices[n0], vertices[n2] - vertices[n0] );
-      normals[n0] += normal;
-      normals[n1] += normal;
-      normals[n2] += normal;
-   }
-   for (auto& n : normals) n = glm::normalize( n );
-}
-
 bool ObjectGL::readObjectFile(
    std::vector<glm::vec3>& vertices,
    std::vector<glm::vec3>& normals,
@@ -325,59 +305,21 @@ bool ObjectGL::readObjectFile(
    const std::string& file_path
 )
 {
-   std::ifstream file(file_path);
-   if (!file.is_open()) {
-      std::cout << "The object file is not correct.\n";
-      return false;
-   }
-
-   bool found_normals = false, found_textures = false;
-   std::vector<glm::vec3> vertex_buffer, normal_buffer;
-   std::vector<glm::vec2> texture_buffer;
-   std::vector<GLuint> vertex_indices, normal_indices, texture_indices;
-   while (!file.eof()) {
-      std::string word;
-      file >> word;
-
-      if (word == "v") {
-         glm::vec3 vertex;
-         file >> vertex.x >> vertex.y >> vertex.z;
-         vertex_buffer.emplace_back( vertex );
-      }
-      else if (word == "vt") {
-         glm::vec2 uv;
-         file >> uv.x >> uv.y;
-         texture_buffer.emplace_back( uv );
-         found_textures = true;
-      }
-      else if (word == "vn") {
-         glm::vec3 normal;
-         file >> normal.x >> normal.y >> normal.z;
-         normal_buffer.emplace_back( normal );
-         found_normals = true;
-      }
-      else if (word == "f") {
-         std::string face;
-         const std::regex delimiter("[/]");
-         for (int i = 0; i < 3; ++i) {
-            file >> face;
-            const std::sregex_token_iterator it(face.begin(), face.end(), delimiter, -1);
-            const std::vector<std::string> vtn(it, std::sregex_token_iterator());
-            vertex_indices.emplace_back( std::stoi( vtn[0] ) - 1 );
-            if (found_textures) texture_indices.emplace_back( std::stoi( vtn[1] ) - 1 );
-            if (found_normals) normal_indices.emplace_back( std::stoi( vtn[2] ) - 1 );
-         }
-      }
-      else std::getline( file, word );
-   }
-
-   if (!found_normals) findNormals( normal_buffer, vertex_buffer, vertex_indices );
-
-   for (size_t i = 0; i < vertex_indices.size(); ++i) {
-      vertices.emplace_back( vertex_buffer[vertex_indices[i]] );
-      if (found_normals) normals.emplace_back( normal_buffer[normal_indices[i]] );
-      else normals.emplace_back( normal_buffer[vertex_indices[i]] );
-      if (found_textures) textures.emplace_back( texture_buffer[texture_indices[i]] );
+   ObjectMesh mesh;
+   if (!MeshCache::read( mesh, file_path )) return false;
+
+   const bool found_normals = mesh.hasNormals();
+   const bool found_textures = mesh.hasTextures();
+
+   const size_t size = mesh.VertexIndices.size();
+   vertices.reserve( size );
+   normals.reserve( size );
+   if (found_textures) textures.reserve( size );
+   for (size_t i = 0; i < size; ++i) {
+      vertices.emplace_back( mesh.Vertices[mesh.VertexIndices[i]] );
+      if (found_normals) normals.emplace_back( mesh.Normals[mesh.NormalIndices[i]] );
+      else normals.emplace_back( mesh.VertexNormals[mesh.VertexIndices[i]] );
+      if (found_textures) textures.emplace_back( mesh.Textures[mesh.TextureIndices[i]] );
    }
    return true;
 }
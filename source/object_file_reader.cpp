@@ -0,0 +1,228 @@
+#include "object_file_reader.h"
+#include "mapped_file.h"
+
+void ObjectMesh::findVertexNormals()
+{
+   VertexNormals.clear();
+   VertexNormals.resize( Vertices.size(), glm::vec3(0.0f) );
+   const auto size = static_cast<int>(VertexIndices.size());
+   for (int i = 0; i < size; i += 3) {
+      const GLuint n0 = VertexIndices[i];
+      const GLuint n1 = VertexIndices[i + 1];
+      const GLuint n2 = VertexIndices[i + 2];
+      const glm::vec3 normal = glm::cross( Vertices[n1] - Vertices[n0], Vertices[n2] - Vertices[n0] );
+      VertexNormals[n0] += normal;
+      VertexNormals[n1] += normal;
+      VertexNormals[n2] += normal;
+   }
+   for (auto& n : VertexNormals) n = glm::normalize( n );
+}
+
+const char* ObjectFileReader::parseFloat(float& value, const char* ptr, const char* end)
+{
+   ptr = skipSpaces( ptr, end );
+   if (ptr < end && *ptr == '+') ++ptr;
+   const auto result = std::from_chars( ptr, end, value );
+   if (result.ec != std::errc()) value = 0.0f;
+   return result.ptr;
+}
+
+const char* ObjectFileReader::parseCorner(Corner& corner, Chunk& chunk, const char* ptr, const char* end)
+{
+   // a corner is one of v, v/t, v//n, or v/t/n.
+   int index = 0;
+   auto result = std::from_chars( ptr, end, index );
+   if (result.ec != std::errc()) return nullptr;
+
+   const ObjectMesh& mesh = chunk.Mesh;
+   const Offset& offset = chunk.ElementOffset;
+   corner = Corner();
+   corner.Vertex = getIndex( index, offset.Vertex + mesh.Vertices.size(), chunk.HasRelativeIndex );
+   ptr = result.ptr;
+   if (ptr < end && *ptr == '/') {
+      ++ptr;
+      result = std::from_chars( ptr, end, index );
+      if (result.ec == std::errc()) {
+         corner.Texture = getIndex( index, offset.Texture + mesh.Textures.size(), chunk.HasRelativeIndex );
+         corner.HasTexture = true;
+         ptr = result.ptr;
+      }
+      if (ptr < end && *ptr == '/') {
+         ++ptr;
+         result = std::from_chars( ptr, end, index );
+         if (result.ec == std::errc()) {
+            corner.Normal = getIndex( index, offset.Normal + mesh.Normals.size(), chunk.HasRelativeIndex );
+            corner.HasNormal = true;
+            ptr = result.ptr;
+         }
+      }
+   }
+   return ptr;
+}
+
+void ObjectFileReader::addCorner(ObjectMesh& mesh, const Corner& corner)
+{
+   mesh.VertexIndices.emplace_back( corner.Vertex );
+   if (corner.HasTexture) mesh.TextureIndices.emplace_back( corner.Texture );
+   if (corner.HasNormal) mesh.NormalIndices.emplace_back( corner.Normal );
+}
+
+const char* ObjectFileReader::parseFace(Chunk& chunk, const char* ptr, const char* end)
+{
+   int corner_num = 0;
+   Corner first, previous, current;
+   while (true) {
+      ptr = skipSpaces( ptr, end );
+      if (ptr >= end || *ptr == '\n' || *ptr == '#') break;
+
+      const char* next = parseCorner( current, chunk, ptr, end );
+      if (next == nullptr) break;
+
+      ptr = next;
+      if (corner_num >= 2) {
+         addCorner( chunk.Mesh, first );
+         addCorner( chunk.Mesh, previous );
+         addCorner( chunk.Mesh, current );
+      }
+      else if (corner_num == 0) first = current;
+      previous = current;
+      corner_num++;
+   }
+   return ptr;
+}
+
+void ObjectFileReader::parseChunk(Chunk& chunk)
+{
+   ObjectMesh& mesh = chunk.Mesh;
+   const char* ptr = chunk.Begin;
+   const char* end = chunk.End;
+   mesh.clear();
+   chunk.HasRelativeIndex = false;
+   while (ptr < end) {
+      ptr = skipSpaces( ptr, end );
+      if (end - ptr > 2 && ptr[0] == 'v') {
+         if (isSpace( ptr[1] )) {
+            glm::vec3 vertex;
+            ptr = parseFloat( vertex.x, ptr + 1, end );
+            ptr = parseFloat( vertex.y, ptr, end );
+            ptr = parseFloat( vertex.z, ptr, end );
+            mesh.Vertices.emplace_back( vertex );
+         }
+         else if (ptr[1] == 't' && isSpace( ptr[2] )) {
+            glm::vec2 uv;
+            ptr = parseFloat( uv.x, ptr + 2, end );
+            ptr = parseFloat( uv.y, ptr, end );
+            mesh.Textures.emplace_back( uv );
+         }
+         else if (ptr[1] == 'n' && isSpace( ptr[2] )) {
+            glm::vec3 normal;
+            ptr = parseFloat( normal.x, ptr + 2, end );
+            ptr = parseFloat( normal.y, ptr, end );
+            ptr = parseFloat( normal.z, ptr, end );
+            mesh.Normals.emplace_back( normal );
+         }
+      }
+      else if (end - ptr > 1 && ptr[0] == 'f' && isSpace( ptr[1] )) ptr = parseFace( chunk, ptr + 1, end );
+      ptr = skipLine( ptr, end );
+   }
+}
+
+void ObjectFileReader::splitIntoChunks(std::vector<Chunk>& chunks, const char* begin, const char* end, int thread_num)
+{
+   // every chunk boundary is moved to the beginning of the next line, so no line is split.
+   const auto size = static_cast<size_t>(end - begin);
+   const size_t chunk_num = std::clamp( size / MinChunkSize, static_cast<size_t>(1), static_cast<size_t>(thread_num) );
+   chunks.resize( chunk_num );
+   const char* ptr = begin;
+   for (size_t i = 0; i < chunk_num; ++i) {
+      chunks[i].Begin = ptr;
+      ptr = i + 1 == chunk_num ? end : skipLine( std::max( ptr, begin + size * (i + 1) / chunk_num ), end );
+      chunks[i].End = ptr;
+   }
+}
+
+void ObjectFileReader::mergeChunk(ObjectMesh& mesh, const Chunk& chunk)
+{
+   const ObjectMesh& source = chunk.Mesh;
+   std::copy( source.Vertices.begin(), source.Vertices.end(), mesh.Vertices.begin() + chunk.ElementOffset.Vertex );
+   std::copy( source.Textures.begin(), source.Textures.end(), mesh.Textures.begin() + chunk.ElementOffset.Texture );
+   std::copy( source.Normals.begin(), source.Normals.end(), mesh.Normals.begin() + chunk.ElementOffset.Normal );
+   std::copy(
+      source.VertexIndices.begin(), source.VertexIndices.end(),
+      mesh.VertexIndices.begin() + chunk.IndexOffset.Vertex
+   );
+   std::copy(
+      source.TextureIndices.begin(), source.TextureIndices.end(),
+      mesh.TextureIndices.begin() + chunk.IndexOffset.Texture
+   );
+   std::copy(
+      source.NormalIndices.begin(), source.NormalIndices.end(),
+      mesh.NormalIndices.begin() + chunk.IndexOffset.Normal
+   );
+}
+
+void ObjectFileReader::parse(ObjectMesh& mesh, const char* begin, const char* end, int thread_num)
+{
+   if (thread_num <= 0) thread_num = std::max( static_cast<int>(std::thread::hardware_concurrency()), 1 );
+
+   std::vector<Chunk> chunks;
+   splitIntoChunks( chunks, begin, end, thread_num );
+   if (chunks.size() == 1) {
+      parseChunk( chunks[0] );
+      mesh = std::move( chunks[0].Mesh );
+      return;
+   }
+
+   const auto run_in_parallel = [&chunks](const std::function<void(Chunk&)>& function)
+   {
+      std::vector<std::thread> threads;
+      threads.reserve( chunks.size() - 1 );
+      for (size_t i = 1; i < chunks.size(); ++i) threads.emplace_back( function, std::ref( chunks[i] ) );
+      function( chunks[0] );
+      for (auto& thread : threads) thread.join();
+   };
+   run_in_parallel( parseChunk );
+
+   // the prefix sums of the chunk sizes place every chunk exactly where a serial parse would have put it.
+   Offset element_offset, index_offset;
+   bool has_relative_index = false;
+   for (size_t i = 0; i < chunks.size(); ++i) {
+      Chunk& chunk = chunks[i];
+      chunk.ElementOffset = element_offset;
+      chunk.IndexOffset = index_offset;
+      element_offset.Vertex += chunk.Mesh.Vertices.size();
+      element_offset.Texture += chunk.Mesh.Textures.size();
+      element_offset.Normal += chunk.Mesh.Normals.size();
+      index_offset.Vertex += chunk.Mesh.VertexIndices.size();
+      index_offset.Texture += chunk.Mesh.TextureIndices.size();
+      index_offset.Normal += chunk.Mesh.NormalIndices.size();
+      if (i > 0 && chunk.HasRelativeIndex) has_relative_index = true;
+   }
+
+   // negative indices could not be resolved without the element offsets, so parse those chunks again.
+   // the element counts do not change, so the offsets stay valid.
+   if (has_relative_index) {
+      run_in_parallel( [](Chunk& chunk) { if (chunk.HasRelativeIndex) parseChunk( chunk ); } );
+   }
+
+   mesh.clear();
+   mesh.Vertices.resize( element_offset.Vertex );
+   mesh.Textures.resize( element_offset.Texture );
+   mesh.Normals.resize( element_offset.Normal );
+   mesh.VertexIndices.resize( index_offset.Vertex );
+   mesh.TextureIndices.resize( index_offset.Texture );
+   mesh.NormalIndices.resize( index_offset.Normal );
+   run_in_parallel( [&mesh](const Chunk& chunk) { mergeChunk( mesh, chunk ); } );
+}
+
+bool ObjectFileReader::read(ObjectMesh& mesh, const std::string& file_path, int thread_num)
+{
+   const MappedFile file(file_path);
+   if (!file.isOpen()) {
+      std::cout << "The object file is not correct.\n";
+      return false;
+   }
+
+   parse( mesh, file.data(), file.end(), thread_num );
+   return true;
+}
@@ -1,89 +1,49 @@
 #include "occlusion_tree.h"
 
 OcclusionTree::OcclusionTree() :
-   ObjectGL(), Robust( false ), RootIndex( NullIndex ), TargetBufferIndex( 0 ), DisksBuffers{ 0, 0 },
-   IndicesBuffer( 0 ), VerticesBuffer( 0 ), ProximityTolerance( 8.0f ), DistanceAttenuation( 0.0f ),
-   TriangleAttenuation( 0.5f )
+   ObjectGL(), Robust( false ), RootIndex( NullIndex ), BranchingFactor( 2 ), LeafSize( 1 ), TargetBufferIndex( 0 ),
+   DisksBuffers{ 0, 0 }, EmittersBuffer( 0 ), ReceiversBuffers{ 0, 0 }, IndicesBuffer( 0 ), VerticesBuffer( 0 ),
+   FaceRangesBuffer( 0 ), QuantizationFramesBuffer( 0 ), ProximityTolerance( 8.0f ), DistanceAttenuation( 0.0f ),
+   MaxOcclusionDistance( std::numeric_limits<float>::max() ), TriangleAttenuation( 0.5f ),
+   BuildMethod( BUILD_METHOD::MEDIAN_SPLIT ), Layout( DISK_LAYOUT::BUILD_ORDER ), Precision( Quantizer::PRECISION::FULL )
 {
 }
 
-bool OcclusionTree::readObjectFile(std::vector<glm::vec3>& normals, const std::string& file_path)
+bool OcclusionTree::readObjectFile(uint64_t& source_hash, const std::string& file_path)
 {
-   std::ifstream file(file_path);
-   if (!file.is_open()) {
-      std::cout << "The object file is not correct.\n";
-      return false;
-   }
+   ObjectMesh mesh;
+   if (!MeshCache::read( mesh, file_path )) return false;
 
-   std::vector<glm::vec3> vertex_buffer, normal_buffer;
-   std::vector<glm::vec2> texture_buffer;
-   std::vector<GLuint> vertex_indices, normal_indices, texture_indices;
-   while (!file.eof()) {
-      std::string word;
-      file >> word;
+   source_hash = mesh.SourceHash;
+   Normals = std::move( mesh.VertexNormals );
+   Vertices = std::move( mesh.Vertices );
+   IndexBuffer = std::move( mesh.VertexIndices );
+   return true;
+}
 
-      if (word == "v") {
-         glm::vec3 vertex;
-         file >> vertex.x >> vertex.y >> vertex.z;
-         vertex_buffer.emplace_back( vertex );
-      }
-      else if (word == "vt") {
-         glm::vec2 uv;
-         file >> uv.x >> uv.y;
-         texture_buffer.emplace_back( uv );
-      }
-      else if (word == "vn") {
-         glm::vec3 normal;
-         file >> normal.x >> normal.y >> normal.z;
-         normal_buffer.emplace_back( normal );
-      }
-      else if (word == "f") {
-         std::string face;
-         const std::regex delimiter("[/]");
-         for (int i = 0; i < 3; ++i) {
-            file >> face;
-            const std::sregex_token_iterator it(face.begin(), face.end(), delimiter, -1);
-            const std::vector<std::string> vtn(it, std::sregex_token_iterator());
-            vertex_indices.emplace_back( std::stoi( vtn[0] ) - 1 );
-            texture_indices.emplace_back( std::stoi( vtn[1] ) - 1 );
-            normal_indices.emplace_back( std::stoi( vtn[2] ) - 1 );
+void OcclusionTree::setFaces(ThreadPool& thread_pool)
+{
+   const auto face_num = static_cast<int>(IndexBuffer.size() / 3);
+   Faces.resize( face_num );
+   TripleCentroids.resize( face_num );
+   thread_pool.runInBlocks(
+      face_num, BuildBlockSize, [this](int begin, int end)
+      {
+         for (int f = begin; f < end; ++f) {
+            const int i = 3 * f;
+            Faces[f] = f;
+            TripleCentroids[f] = Vertices[IndexBuffer[i]] + Vertices[IndexBuffer[i + 1]] + Vertices[IndexBuffer[i + 2]];
          }
       }
-      else std::getline( file, word );
-   }
-
-   normals.resize( vertex_buffer.size(), glm::vec3(0.0f) );
-   const auto size = static_cast<int>(vertex_indices.size());
-   for (int i = 0; i < size; i += 3) {
-      const GLuint v0 = vertex_indices[i];
-      const GLuint v1 = vertex_indices[i + 1];
-      const GLuint v2 = vertex_indices[i + 2];
-      const glm::vec3 n = glm::cross( vertex_buffer[v1] - vertex_buffer[v0], vertex_buffer[v2] - vertex_buffer[v0] );
-      normals[v0] += n;
-      normals[v1] += n;
-      normals[v2] += n;
-   }
-   for (auto& n : normals) n = glm::normalize( n );
-   Vertices = std::move( vertex_buffer );
-   IndexBuffer = std::move( vertex_indices );
-   return true;
+   );
 }
 
-void OcclusionTree::getBoundary(
-   glm::vec3& min_point,
-   glm::vec3& max_point,
-   const std::vector<int>::iterator& begin,
-   const std::vector<int>::iterator& end
-)
+void OcclusionTree::getBoundary(glm::vec3& min_point, glm::vec3& max_point, int begin, int end) const
 {
    min_point = glm::vec3(std::numeric_limits<float>::max());
    max_point = glm::vec3(std::numeric_limits<float>::lowest());
-   for (auto face_index = begin; face_index != end; ++face_index) {
-      const int i = 3 * *face_index;
-      const glm::vec3 v0 = Vertices[IndexBuffer[i]];
-      const glm::vec3 v1 = Vertices[IndexBuffer[i + 1]];
-      const glm::vec3 v2 = Vertices[IndexBuffer[i + 2]];
-      const glm::vec3 centroid = (v0 + v1 + v2) / 3.0f;
+   for (int i = begin; i < end; ++i) {
+      const glm::vec3 centroid = TripleCentroids[Faces[i]] / 3.0f;
       if (centroid.x < min_point.x) min_point.x = centroid.x;
       if (centroid.y < min_point.y) min_point.y = centroid.y;
       if (centroid.z < min_point.z) min_point.z = centroid.z;
@@ -118,6 +78,18 @@ int OcclusionTree::getDominantAxis(const glm::vec3& p0, const glm::vec3& p1)
    return axis;
 }
 
+// the angle between the unit vectors u and v, which is also accurate when they are almost parallel.
+float OcclusionTree::getAngle(const glm::vec3& u, const glm::vec3& v)
+{
+   return std::atan2( glm::length( glm::cross( u, v ) ), glm::dot( u, v ) );
+}
+
+float OcclusionTree::getConeSine(float angle)
+{
+   const float widened = angle + ConeAngleError;
+   return widened < glm::half_pi<float>() ? std::sin( widened ) : 1.0f;
+}
+
 void OcclusionTree::setParentDisk(Disk& parent_disk)
 {
    const Disk& left_disk = Disks[parent_disk.LeftChildIndex];
@@ -128,136 +100,812 @@ void OcclusionTree::setParentDisk(Disk& parent_disk)
    parent_disk.Normal = glm::normalize( glm::mix( left_disk.Normal, right_disk.Normal, weight ) );
    if (std::isnan( parent_disk.Centroid.x )) parent_disk.Centroid = (left_disk.Centroid + right_disk.Centroid) * 0.5f;
    if (std::isnan( parent_disk.Normal.x )) parent_disk.Normal = glm::normalize( parent_disk.Centroid );
+   if (std::isnan( parent_disk.Normal.x )) parent_disk.Normal = glm::vec3(0.0f, 0.0f, 1.0f);
+   parent_disk.Radius = std::max(
+      glm::distance( left_disk.Centroid, parent_disk.Centroid ) + left_disk.Radius,
+      glm::distance( right_disk.Centroid, parent_disk.Centroid ) + right_disk.Radius
+   );
+
+   // the cone around the parent normal which holds the cones of both children. a child without area casts no shadow,
+   // so its normal does not widen the cone.
+   float cone_angle = 0.0f;
+   for (const Disk* child : { &left_disk, &right_disk }) {
+      if (child->AreaOverPi <= 0.0f) continue;
+      if (!(child->ConeSine < 1.0f)) {
+         cone_angle = glm::half_pi<float>();
+         break;
+      }
+      cone_angle = std::max( cone_angle, getAngle( parent_disk.Normal, child->Normal ) + std::asin( child->ConeSine ) );
+   }
+   parent_disk.ConeSine = getConeSine( cone_angle );
 }
 
-int OcclusionTree::build(
-   int parent_index,
-   const std::vector<int>::iterator& begin,
-   const std::vector<int>::iterator& end
-)
+// the leaf disk of the faces in [begin, end) of Faces has their total area, and area-weighted centroid and normal.
+void OcclusionTree::setLeafDisk(int leaf_index, int begin, int end, int parent_index)
 {
-   assert( begin <= end );
-
-   if (begin == end) return NullIndex;
-   else if (begin + 1 == end) {
-      Disk disk;
-      const int i = 3 * *begin;
+   Disk disk(parent_index);
+   float twice_area = 0.0f;
+   glm::vec3 normal(0.0f), weighted_triple_centroid(0.0f), triple_centroid(0.0f);
+   for (int f = begin; f < end; ++f) {
+      const int i = 3 * Faces[f];
       const glm::vec3 v0 = Vertices[IndexBuffer[i]];
       const glm::vec3 v1 = Vertices[IndexBuffer[i + 1]];
       const glm::vec3 v2 = Vertices[IndexBuffer[i + 2]];
       const glm::vec3 n = glm::cross( v1 - v0, v2 - v0 );
-      disk.Normal = glm::normalize( n );
-      disk.AreaOverPi = glm::length( n ) * 0.5f / glm::pi<float>();
-      disk.Centroid = (v0 + v1 + v2) / 3.0f;
-      disk.ParentIndex = parent_index;
-      Disks[*begin] = disk;
-      return *begin;
+      const float length = glm::length( n );
+      normal += n;
+      twice_area += length;
+      weighted_triple_centroid += length * (v0 + v1 + v2);
+      triple_centroid += v0 + v1 + v2;
    }
+   disk.Normal = glm::normalize( normal );
 
+   // the triangles of a degenerate leaf have no normal. the leaf takes any unit normal and no area instead of a NaN
+   // normal, which would spread into the accessibility of every receiver, so it casts no shadow in all the passes.
+   const bool degenerate = std::isnan( disk.Normal.x );
+   if (degenerate) {
+      disk.Normal = glm::vec3(0.0f, 0.0f, 1.0f);
+      twice_area = 0.0f;
+   }
+   disk.AreaOverPi = twice_area * 0.5f / glm::pi<float>();
+   disk.Centroid = twice_area > 0.0f ?
+      weighted_triple_centroid / (3.0f * twice_area) :
+      triple_centroid / (3.0f * static_cast<float>(end - begin));
+   for (int f = begin; f < end; ++f) {
+      for (int j = 0; j < 3; ++j) {
+         disk.Radius = std::max( disk.Radius, glm::distance( Vertices[IndexBuffer[3 * Faces[f] + j]], disk.Centroid ) );
+      }
+   }
+
+   float cone_angle = 0.0f;
+   for (int f = begin; f < end; ++f) {
+      const int i = 3 * Faces[f];
+      const glm::vec3 v0 = Vertices[IndexBuffer[i]];
+      const glm::vec3 n = glm::cross( Vertices[IndexBuffer[i + 1]] - v0, Vertices[IndexBuffer[i + 2]] - v0 );
+      const float length = glm::length( n );
+      if (length > 0.0f) cone_angle = std::max( cone_angle, getAngle( disk.Normal, n / length ) );
+   }
+   disk.ConeSine = degenerate ? 1.0f : getConeSine( cone_angle );
+   disk.FaceBegin = begin;
+   disk.FaceCount = end - begin;
+   Disks[leaf_index] = disk;
+}
+
+// split the faces in [begin, end) of Faces at the median along the dominant axis, and set the disk of the range at node.
+// the faces of the same centroid are ordered by their indices, so the halves do not depend on the order of Faces.
+// the left half takes the first half of the leaves, which are full, so every range begins at a multiple of LeafSize.
+int OcclusionTree::splitDisks(int parent_index, int begin, int end, int node)
+{
    glm::vec3 min_point, max_point;
    getBoundary( min_point, max_point, begin, end );
    const int dominant_axis = getDominantAxis( min_point, max_point );
-   std::sort(
-      begin, end,
+   const int middle = begin + LeafSize * (getLeafNum( end - begin ) / 2);
+   std::nth_element(
+      Faces.begin() + begin, Faces.begin() + middle, Faces.begin() + end,
       [this, dominant_axis](int a, int b)
       {
-         const int i = 3 * a;
-         const int j = 3 * b;
-         const float triple_centroid_a =
-            Vertices[IndexBuffer[i]][dominant_axis] +
-            Vertices[IndexBuffer[i + 1]][dominant_axis] +
-            Vertices[IndexBuffer[i + 2]][dominant_axis];
-         const float triple_centroid_b =
-            Vertices[IndexBuffer[j]][dominant_axis] +
-            Vertices[IndexBuffer[j + 1]][dominant_axis] +
-            Vertices[IndexBuffer[j + 2]][dominant_axis];
-         return triple_centroid_a < triple_centroid_b;
+         const float triple_centroid_a = TripleCentroids[a][dominant_axis];
+         const float triple_centroid_b = TripleCentroids[b][dominant_axis];
+         return triple_centroid_a < triple_centroid_b || (triple_centroid_a == triple_centroid_b && a < b);
       }
    );
-   const auto mid = begin + (end - begin) / 2;
 
-   assert( begin <= mid && mid <= end && begin <= end );
+   Disk& disk = Disks[node];
+   disk = Disk(parent_index);
+   disk.LeftChildIndex = getSubtreeRoot( begin, middle, node + 1 );
+   disk.RightChildIndex = getSubtreeRoot( middle, end, node + (middle - begin) / LeafSize );
+   return middle;
+}
 
-   const auto location = static_cast<int>(Disks.size());
-   Disk& new_disk = Disks.emplace_back( parent_index );
-   new_disk.LeftChildIndex = build( location, begin, mid );
-   new_disk.RightChildIndex = build( location, mid, end );
+// build the subtree of the faces in [begin, end) of Faces, and return its root.
+// the internal disks are placed in order from node, and a subtree of n leaves takes n - 1 of them.
+int OcclusionTree::build(int parent_index, int begin, int end, int node)
+{
+   assert( begin < end );
 
-   assert( new_disk.LeftChildIndex != NullIndex && new_disk.RightChildIndex != NullIndex );
+   if (end - begin <= LeafSize) {
+      const int leaf = begin / LeafSize;
+      setLeafDisk( leaf, begin, end, parent_index );
+      return leaf;
+   }
 
-   setParentDisk( new_disk );
-   return location;
+   const int middle = splitDisks( parent_index, begin, end, node );
+   static_cast<void>(build( node, begin, middle, node + 1 ));
+   static_cast<void>(build( node, middle, end, node + (middle - begin) / LeafSize ));
+   setParentDisk( Disks[node] );
+   return node;
 }
 
-int OcclusionTree::getNextIndex(int index)
+int OcclusionTree::buildWithMedianSplit()
 {
-   if (index == RootIndex) return NullIndex;
-   else {
-      const Disk& disk = Disks[index];
-      const Disk& parent_disk = Disks[disk.ParentIndex];
-      return parent_disk.LeftChildIndex == index ? parent_disk.RightChildIndex : getNextIndex( disk.ParentIndex );
+   const auto face_num = static_cast<int>(IndexBuffer.size() / 3);
+   Disks.clear();
+   if (face_num == 0) return NullIndex;
+
+   const int leaf_num = getLeafNum( face_num );
+   Disks.resize( 2 * leaf_num - 1 );
+   ThreadPool thread_pool;
+   setFaces( thread_pool );
+
+   // the large ranges are split level by level, every range of a level in parallel, until they are small enough
+   // to be built as one task. the disk positions do not depend on the order of the tasks.
+   std::vector<DiskRange> tasks;
+   std::vector<std::vector<DiskRange>> levels;
+   std::vector<DiskRange> ranges{ DiskRange( 0, face_num, leaf_num, NullIndex ) };
+   while (!ranges.empty()) {
+      std::vector<DiskRange>& large_ranges = levels.emplace_back();
+      for (const auto& range : ranges) {
+         if (range.End - range.Begin > ParallelBuildThreshold) large_ranges.emplace_back( range );
+         else tasks.emplace_back( range );
+      }
+      ranges.resize( large_ranges.size() * 2 );
+      thread_pool.run(
+         static_cast<int>(large_ranges.size()), [&](int i)
+         {
+            const DiskRange& range = large_ranges[i];
+            const int middle = splitDisks( range.ParentIndex, range.Begin, range.End, range.Node );
+            ranges[2 * i] = DiskRange( range.Begin, middle, range.Node + 1, range.Node );
+            ranges[2 * i + 1] =
+               DiskRange( middle, range.End, range.Node + (middle - range.Begin) / LeafSize, range.Node );
+         }
+      );
    }
+   std::stable_sort(
+      tasks.begin(), tasks.end(),
+      [](const DiskRange& a, const DiskRange& b) { return a.End - a.Begin > b.End - b.Begin; }
+   );
+   thread_pool.run(
+      static_cast<int>(tasks.size()), [&](int i)
+      {
+         static_cast<void>(build( tasks[i].ParentIndex, tasks[i].Begin, tasks[i].End, tasks[i].Node ));
+      }
+   );
+
+   // the disks of the split ranges are set from the deepest level, whose children are all set by then.
+   for (auto level = levels.rbegin(); level != levels.rend(); ++level) {
+      thread_pool.run( static_cast<int>(level->size()), [&](int i) { setParentDisk( Disks[(*level)[i].Node] ); } );
+   }
+
+   return getSubtreeRoot( 0, face_num, leaf_num );
 }
 
-void OcclusionTree::createOcclusionTree(const std::string& obj_file_path)
+// the next disk of a left child is its sibling, and the next disk of a right child is the next disk of its parent.
+// so every next disk is set in one pass from the root, where a parent is visited before its children.
+void OcclusionTree::setNextIndices()
+{
+   if (RootIndex == NullIndex) return;
+
+   Disks[RootIndex].NextIndex = NullIndex;
+   std::vector<int> stack{ RootIndex };
+   while (!stack.empty()) {
+      const Disk& disk = Disks[stack.back()];
+      stack.pop_back();
+      if (disk.LeftChildIndex == NullIndex) continue;
+
+      Disks[disk.LeftChildIndex].NextIndex = disk.RightChildIndex;
+      Disks[disk.RightChildIndex].NextIndex = disk.NextIndex;
+      stack.emplace_back( disk.RightChildIndex );
+      stack.emplace_back( disk.LeftChildIndex );
+   }
+}
+
+uint32_t OcclusionTree::getMortonCode(const glm::vec3& point)
+{
+   // spread the 10 bits of a coordinate in [0, 1] out to every third bit, and interleave them as xyzxyz...
+   const auto expand = [](uint32_t v)
+   {
+      v = (v * 0x00010001u) & 0xFF0000FFu;
+      v = (v * 0x00000101u) & 0x0F00F00Fu;
+      v = (v * 0x00000011u) & 0xC30C30C3u;
+      v = (v * 0x00000005u) & 0x49249249u;
+      return v;
+   };
+   constexpr auto scale = static_cast<float>(1 << MortonBitsPerAxis);
+   const glm::uvec3 q = glm::uvec3(glm::clamp( point * scale, glm::vec3(0.0f), glm::vec3(scale - 1.0f) ));
+   return expand( q.x ) << 2 | expand( q.y ) << 1 | expand( q.z );
+}
+
+int OcclusionTree::getCommonPrefixLength(uint64_t a, uint64_t b)
+{
+   uint64_t x = a ^ b;
+   if (x == 0) return 64;
+
+   int length = 0;
+   for (int shift = 32; shift > 0; shift >>= 1) {
+      if (x >> (64 - shift) == 0) {
+         length += shift;
+         x <<= shift;
+      }
+   }
+   return length;
+}
+
+// a key has the Morton code of a face centroid in its upper half and the face index in its lower half,
+// so that all the keys are different even if some codes are the same.
+void OcclusionTree::getMortonKeys(std::vector<uint64_t>& keys, ThreadPool& thread_pool)
+{
+   const auto face_num = static_cast<int>(IndexBuffer.size() / 3);
+   setFaces( thread_pool );
+   glm::vec3 min_point, max_point;
+   getBoundary( min_point, max_point, 0, face_num );
+   const glm::vec3 extent = glm::max( max_point - min_point, glm::vec3(std::numeric_limits<float>::min()) );
+
+   keys.resize( face_num );
+   thread_pool.runInBlocks(
+      face_num, BuildBlockSize, [&](int begin, int end)
+      {
+         for (int f = begin; f < end; ++f) {
+            const uint32_t code = getMortonCode( (TripleCentroids[f] / 3.0f - min_point) / extent );
+            keys[f] = static_cast<uint64_t>(code) << 32 | static_cast<uint64_t>(f);
+         }
+      }
+   );
+}
+
+// a stable LSD radix sort of the Morton codes. the keys are already in the order of the face indices,
+// so the faces which have the same code stay in that order.
+void OcclusionTree::sortMortonKeys(std::vector<uint64_t>& keys, ThreadPool& thread_pool)
+{
+   constexpr int bucket_num = 1 << RadixBits;
+   const auto size = static_cast<int>(keys.size());
+   const int chunk_num = std::clamp( size / BuildBlockSize, 1, thread_pool.getThreadNum() );
+   const int chunk_size = (size + chunk_num - 1) / chunk_num;
+   std::vector<uint64_t> buffer(size);
+   std::vector<std::array<int, bucket_num>> offsets(chunk_num);
+   for (int shift = 32; shift < 32 + 3 * MortonBitsPerAxis; shift += RadixBits) {
+      thread_pool.runInBlocks(
+         size, chunk_size, [&](int begin, int end)
+         {
+            auto& counts = offsets[begin / chunk_size];
+            counts.fill( 0 );
+            for (int i = begin; i < end; ++i) counts[keys[i] >> shift & (bucket_num - 1)]++;
+         }
+      );
+
+      // the chunks of a bucket are placed in the order of the chunks, which keeps the sort stable.
+      int offset = 0;
+      for (int b = 0; b < bucket_num; ++b) {
+         for (auto& counts : offsets) {
+            const int count = counts[b];
+            counts[b] = offset;
+            offset += count;
+         }
+      }
+
+      thread_pool.runInBlocks(
+         size, chunk_size, [&](int begin, int end)
+         {
+            auto& positions = offsets[begin / chunk_size];
+            for (int i = begin; i < end; ++i) buffer[positions[keys[i] >> shift & (bucket_num - 1)]++] = keys[i];
+         }
+      );
+      keys.swap( buffer );
+   }
+}
+
+// find where the keys in [first, last], which share a common prefix, split into the ones whose next bit is 0 and 1.
+int OcclusionTree::getMortonSplit(const std::vector<uint64_t>& keys, int first, int last) const
+{
+   const int common_prefix = getCommonPrefixLength( keys[first], keys[last] );
+   int split = first;
+   int step = last - first;
+   do {
+      step = (step + 1) >> 1;
+      const int new_split = split + step;
+      if (new_split < last && getCommonPrefixLength( keys[first], keys[new_split] ) > common_prefix) {
+         split = new_split;
+      }
+   } while (step > 1);
+   return split;
+}
+
+// the n - 1 internal nodes of a linear BVH over n sorted keys can be set independently. [Karras 2012]
+// the keys are the first sorted keys of the leaves, so the internal node i is the disk Disks[n + i], and the leaf of
+// the key i is the disk Disks[i].
+void OcclusionTree::setMortonChildren(const std::vector<uint64_t>& keys, int node)
+{
+   const auto size = static_cast<int>(keys.size());
+   const auto delta = [&keys, size, node](int j)
+   {
+      return j < 0 || j >= size ? -1 : getCommonPrefixLength( keys[node], keys[j] );
+   };
+
+   // find the other end of the range which the node covers.
+   const int direction = delta( node + 1 ) > delta( node - 1 ) ? 1 : -1;
+   const int min_delta = delta( node - direction );
+   int max_length = 2;
+   while (delta( node + max_length * direction ) > min_delta) max_length *= 2;
+   int length = 0;
+   for (int t = max_length / 2; t >= 1; t /= 2) {
+      if (delta( node + (length + t) * direction ) > min_delta) length += t;
+   }
+   const int other = node + length * direction;
+   const int first = std::min( node, other );
+   const int last = std::max( node, other );
+
+   const int split = getMortonSplit( keys, first, last );
+   const auto get_disk_index = [size](int i, bool is_leaf) { return is_leaf ? i : size + i; };
+   const int location = size + node;
+   Disk& disk = Disks[location];
+   disk.LeftChildIndex = get_disk_index( split, split == first );
+   disk.RightChildIndex = get_disk_index( split + 1, split + 1 == last );
+   Disks[disk.LeftChildIndex].ParentIndex = location;
+   Disks[disk.RightChildIndex].ParentIndex = location;
+}
+
+int OcclusionTree::buildWithMortonCodes()
+{
+   const auto face_num = static_cast<int>(IndexBuffer.size() / 3);
+   Disks.clear();
+   if (face_num == 0) return NullIndex;
+
+   const int leaf_num = getLeafNum( face_num );
+   Disks.resize( 2 * leaf_num - 1 );
+   ThreadPool thread_pool;
+   std::vector<uint64_t> keys;
+   getMortonKeys( keys, thread_pool );
+   TripleCentroids = std::vector<glm::vec3>();
+   sortMortonKeys( keys, thread_pool );
+
+   // the leaf i takes the faces of the sorted keys in [LeafSize * i, LeafSize * (i + 1)), and its first key.
+   for (int i = 0; i < face_num; ++i) Faces[i] = static_cast<int>(keys[i] & 0xffffffffull);
+   for (int i = 1; i < leaf_num; ++i) keys[i] = keys[LeafSize * i];
+   keys.resize( leaf_num );
+   thread_pool.runInBlocks(
+      leaf_num - 1, BuildBlockSize, [&](int begin, int end)
+      {
+         for (int i = begin; i < end; ++i) setMortonChildren( keys, i );
+      }
+   );
+   thread_pool.runInBlocks(
+      leaf_num, BuildBlockSize, [&](int begin, int end)
+      {
+         for (int i = begin; i < end; ++i) {
+            setLeafDisk( i, LeafSize * i, std::min( LeafSize * (i + 1), face_num ), Disks[i].ParentIndex );
+         }
+      }
+   );
+
+   // a parent disk is set by whichever of its children arrives second, when both of them are set.
+   std::vector<std::atomic<int>> arrivals(leaf_num - 1);
+   for (auto& arrival : arrivals) arrival = 0;
+   thread_pool.runInBlocks(
+      leaf_num, BuildBlockSize, [&](int begin, int end)
+      {
+         for (int i = begin; i < end; ++i) {
+            for (int parent = Disks[i].ParentIndex; parent != NullIndex; parent = Disks[parent].ParentIndex) {
+               if (arrivals[parent - leaf_num]++ == 0) break;
+               setParentDisk( Disks[parent] );
+            }
+         }
+      }
+   );
+   return leaf_num == 1 ? 0 : leaf_num;
+}
+
+// collapse the binary tree so that an internal disk has up to BranchingFactor children. the children of a disk start
+// from its two binary children, and the largest internal one of them is replaced by its own two children until there
+// are enough. a collapsed disk keeps the centroid, area, and normal of its binary disk, and the children of a disk are
+// stored next to each other, group by group from the root, so that a receiver fetches a sibling group together.
+void OcclusionTree::collapseDisks()
+{
+   const auto disk_size = static_cast<int>(Disks.size());
+   std::vector<Disk> collapsed;
+   std::vector<int> sources;
+   collapsed.reserve( disk_size );
+   sources.reserve( disk_size );
+   collapsed.emplace_back( Disks[RootIndex] );
+   collapsed.back().ParentIndex = NullIndex;
+   collapsed.back().NextIndex = NullIndex;
+   sources.emplace_back( RootIndex );
+
+   std::vector<int> locations(disk_size, NullIndex);
+   std::vector<int> children;
+   for (int i = 0; i < static_cast<int>(collapsed.size()); ++i) {
+      const Disk& source = Disks[sources[i]];
+      if (source.LeftChildIndex == NullIndex) {
+         locations[sources[i]] = i;
+         continue;
+      }
+
+      children.assign( { source.LeftChildIndex, source.RightChildIndex } );
+      while (static_cast<int>(children.size()) < BranchingFactor) {
+         int largest = NullIndex;
+         for (int c = 0; c < static_cast<int>(children.size()); ++c) {
+            const Disk& child = Disks[children[c]];
+            if (child.LeftChildIndex != NullIndex &&
+                (largest == NullIndex || child.AreaOverPi > Disks[children[largest]].AreaOverPi)) {
+               largest = c;
+            }
+         }
+         if (largest == NullIndex) break;
+
+         const Disk& child = Disks[children[largest]];
+         children[largest] = child.LeftChildIndex;
+         children.insert( children.begin() + largest + 1, child.RightChildIndex );
+      }
+
+      const auto first = static_cast<int>(collapsed.size());
+      const auto child_num = static_cast<int>(children.size());
+      for (int c = 0; c < child_num; ++c) {
+         Disk disk = Disks[children[c]];
+         disk.ParentIndex = i;
+         disk.NextIndex = c + 1 < child_num ? first + c + 1 : collapsed[i].NextIndex;
+         collapsed.emplace_back( disk );
+         sources.emplace_back( children[c] );
+      }
+      collapsed[i].LeftChildIndex = first;
+      collapsed[i].RightChildIndex = first + child_num - 1;
+   }
+   for (auto& leaf : FaceDisks) leaf = locations[leaf];
+   Disks = std::move( collapsed );
+   RootIndex = 0;
+}
+
+// store the disks one sibling group at a time, where the children of a disk are next to each other, followed by the
+// subtree of each child in the same way. a receiver which tests a disk reads its siblings from the same cache lines,
+// and the subtrees which it descends into right after are close behind them.
+void OcclusionTree::reorderDisksDepthFirst()
+{
+   const auto disk_size = static_cast<int>(Disks.size());
+   std::vector<int> locations(disk_size, NullIndex);
+   std::vector<Disk> reordered(disk_size);
+   int location = 0;
+   locations[RootIndex] = location;
+   reordered[location++] = Disks[RootIndex];
+   std::vector<int> stack{ RootIndex };
+   std::vector<int> children;
+   while (!stack.empty()) {
+      const Disk& disk = Disks[stack.back()];
+      stack.pop_back();
+      if (disk.LeftChildIndex == NullIndex) continue;
+
+      // the siblings are linked from the left child to the right child in every branching factor.
+      children.clear();
+      for (int child = disk.LeftChildIndex;; child = Disks[child].NextIndex) {
+         children.emplace_back( child );
+         locations[child] = location;
+         reordered[location++] = Disks[child];
+         if (child == disk.RightChildIndex) break;
+      }
+      stack.insert( stack.end(), children.rbegin(), children.rend() );
+   }
+
+   assert( location == disk_size );
+
+   const auto relocate = [&locations](int& index) { if (index != NullIndex) index = locations[index]; };
+   for (auto& disk : reordered) {
+      relocate( disk.ParentIndex );
+      relocate( disk.NextIndex );
+      relocate( disk.LeftChildIndex );
+      relocate( disk.RightChildIndex );
+   }
+
+   for (auto& leaf : FaceDisks) leaf = locations[leaf];
+   Disks = std::move( reordered );
+   relocate( RootIndex );
+}
+
+void OcclusionTree::setLeafFaces()
+{
+   FaceDisks.resize( Faces.size() );
+   for (int i = 0; i < static_cast<int>(Faces.size()); ++i) FaceDisks[Faces[i]] = i / LeafSize;
+   LeafFaces = std::move( Faces );
+   Faces = std::vector<int>();
+   TripleCentroids = std::vector<glm::vec3>();
+}
+
+void OcclusionTree::buildDisks()
+{
+   RootIndex = BuildMethod == BUILD_METHOD::MORTON_CODE ? buildWithMortonCodes() : buildWithMedianSplit();
+   setLeafFaces();
+   setNextIndices();
+   if (BranchingFactor > 2 && RootIndex != NullIndex) collapseDisks();
+   if (Layout != DISK_LAYOUT::BUILD_ORDER && RootIndex != NullIndex) reorderDisksDepthFirst();
+}
+
+uint64_t OcclusionTree::getBuildSettingsHash() const
+{
+   const std::array<uint32_t, 5> settings{
+      BuilderVersion, static_cast<uint32_t>(BuildMethod), static_cast<uint32_t>(Layout != DISK_LAYOUT::BUILD_ORDER),
+      static_cast<uint32_t>(BranchingFactor), static_cast<uint32_t>(LeafSize)
+   };
+   return MeshCache::getHash( settings.data(), sizeof( settings ) );
+}
+
+bool OcclusionTree::loadDisks(const std::string& cache_file_path, uint64_t source_hash)
+{
+   const MappedFile cache(cache_file_path);
+   if (!cache.isOpen()) return false;
+
+   DiskCacheHeader header;
+   const char* ptr = cache.data();
+   if (!MeshCache::readStruct( header, ptr, cache.end() )) return false;
+   if (header.Magic != DiskCacheHeader().Magic || header.Version != DiskCacheVersion ||
+       header.DiskBytes != sizeof( Disk ) || header.SourceHash != source_hash ||
+       header.SettingsHash != getBuildSettingsHash()) {
+      return false;
+   }
+   if (!MeshCache::readArray( Disks, header.DiskNum, ptr, cache.end() ) ||
+       !MeshCache::readArray( FaceDisks, header.FaceDiskNum, ptr, cache.end() ) ||
+       !MeshCache::readArray( LeafFaces, header.LeafFaceNum, ptr, cache.end() )) {
+      Disks.clear();
+      FaceDisks.clear();
+      LeafFaces.clear();
+      return false;
+   }
+   RootIndex = header.RootIndex;
+   return true;
+}
+
+void OcclusionTree::saveDisks(const std::string& cache_file_path, uint64_t source_hash) const
+{
+   {
+      std::ofstream file(MeshCache::getTemporaryFilePath( cache_file_path ), std::ios::binary | std::ios::trunc);
+      if (!file.is_open()) return;
+
+      DiskCacheHeader header;
+      header.SourceHash = source_hash;
+      header.SettingsHash = getBuildSettingsHash();
+      header.RootIndex = RootIndex;
+      header.DiskNum = Disks.size();
+      header.FaceDiskNum = FaceDisks.size();
+      header.LeafFaceNum = LeafFaces.size();
+      MeshCache::writeStruct( file, header );
+      MeshCache::writeArray( file, Disks );
+      MeshCache::writeArray( file, FaceDisks );
+      MeshCache::writeArray( file, LeafFaces );
+      if (!file.good()) return;
+   }
+   MeshCache::commitTemporaryFile( cache_file_path );
+}
+
+bool OcclusionTree::buildOcclusionTree(
+   const std::string& obj_file_path,
+   bool use_cache,
+   BUILD_METHOD build_method,
+   DISK_LAYOUT layout,
+   int branching_factor,
+   int leaf_size
+)
+{
+   BuildMethod = build_method;
+   Layout = layout;
+   BranchingFactor = std::clamp( branching_factor, 2, MaxBranchingFactor );
+   LeafSize = std::clamp( leaf_size, 1, MaxLeafSize );
+   uint64_t source_hash = 0;
+   if (!readObjectFile( source_hash, obj_file_path )) return false;
+
+   const std::string cache_file_path = MeshCache::getCacheFilePath( obj_file_path, ".aotree" );
+   if (!use_cache || !loadDisks( cache_file_path, source_hash )) {
+      buildDisks();
+      if (use_cache) saveDisks( cache_file_path, source_hash );
+   }
+   setQuantizationFrames();
+   return true;
+}
+
+void OcclusionTree::createOcclusionTree(
+   const std::string& obj_file_path,
+   BUILD_METHOD build_method,
+   DISK_LAYOUT layout,
+   int branching_factor,
+   int leaf_size,
+   Quantizer::PRECISION precision
+)
 {
    DrawMode = GL_TRIANGLES;
-   std::vector<glm::vec3> normals;
-   if (!readObjectFile( normals, obj_file_path )) return;
+   Precision = precision;
+   if (!buildOcclusionTree( obj_file_path, true, build_method, layout, branching_factor, leaf_size )) return;
 
    for (int i = 0; i < static_cast<int>(Vertices.size()); ++i) {
       DataBuffer.emplace_back( Vertices[i].x );
       DataBuffer.emplace_back( Vertices[i].y );
       DataBuffer.emplace_back( Vertices[i].z );
-      DataBuffer.emplace_back( normals[i].x );
-      DataBuffer.emplace_back( normals[i].y );
-      DataBuffer.emplace_back( normals[i].z );
+      DataBuffer.emplace_back( Normals[i].x );
+      DataBuffer.emplace_back( Normals[i].y );
+      DataBuffer.emplace_back( Normals[i].z );
       VerticesCount++;
    }
-   normals.clear();
 
    const auto n_bytes_per_vertex = static_cast<int>(6 * sizeof( GLfloat ));
    prepareVertexBuffer( n_bytes_per_vertex );
    prepareNormal();
    prepareIndexBuffer();
+}
 
-   const size_t face_num = IndexBuffer.size() / 3;
+void OcclusionTree::getHotColdDisks(
+   std::vector<EmitterForShader>& emitters,
+   std::vector<ReceiverForShader>& receivers
+) const
+{
+   emitters.resize( Disks.size() );
+   receivers.resize( Disks.size() );
+   for (size_t i = 0; i < Disks.size(); ++i) {
+      emitters[i].Centroid = Disks[i].Centroid;
+      emitters[i].AreaOverPi = Disks[i].AreaOverPi;
+      emitters[i].Normal = Quantizer::getOctahedralNormal( Disks[i].Normal );
+      emitters[i].NextIndex = Disks[i].NextIndex;
+      emitters[i].ChildIndex = Disks[i].LeftChildIndex;
+      emitters[i].RadiusAndCone = Quantizer::getRadiusAndCone(
+         Disks[i].Radius, Quantizer::getOctahedralConeSine( Disks[i].ConeSine )
+      );
+      receivers[i].BentNormal = Disks[i].BentNormal;
+      receivers[i].Accessibility = Disks[i].Accessibility;
+   }
+}
 
-   Disks.clear();
-   Disks.resize( face_num );
+void OcclusionTree::setQuantizationFrames()
+{
+   const auto disk_size = static_cast<int>(Disks.size());
+   QuantizationFrames.clear();
+   for (int begin = 0; begin < disk_size; begin += Quantizer::FrameSize) {
+      glm::vec3 min_point(std::numeric_limits<float>::max());
+      glm::vec3 max_point(std::numeric_limits<float>::lowest());
+      float max_area = 0.0f;
+      for (int i = begin; i < std::min( begin + Quantizer::FrameSize, disk_size ); ++i) {
+         min_point = glm::min( min_point, Disks[i].Centroid );
+         max_point = glm::max( max_point, Disks[i].Centroid );
+         if (std::isfinite( Disks[i].AreaOverPi )) max_area = std::max( max_area, Disks[i].AreaOverPi );
+      }
+      QuantizationFrames.emplace_back( Quantizer::getFrame( min_point, max_point, max_area ) );
+   }
+}
 
-   std::vector<int> indexer(face_num);
-   std::iota( indexer.begin(), indexer.end(), 0 );
-   RootIndex = build( NullIndex, indexer.begin(), indexer.end() );
+void OcclusionTree::getQuantizedEmitters(std::vector<QuantizedEmitterForShader>& emitters) const
+{
+   // a quantized centroid is off by up to half a cell of its frame on each axis, and so are the centroids of its
+   // subtree, which may reach into other frames. the traversal visits a disk before its subtree, so the largest cell
+   // of every subtree is gathered in the reverse order of the traversal.
+   const auto disk_size = static_cast<int>(Disks.size());
+   std::vector<int> order;
+   order.reserve( Disks.size() );
+   for (int i = RootIndex; i != NullIndex;) {
+      order.emplace_back( i );
+      i = Disks[i].LeftChildIndex != NullIndex ? Disks[i].LeftChildIndex : Disks[i].NextIndex;
+   }
+   std::vector<float> centroid_errors(disk_size, 0.0f);
+   for (auto it = order.rbegin(); it != order.rend(); ++it) {
+      const Disk& disk = Disks[*it];
+      centroid_errors[*it] = glm::length( Quantizer::getCell( getQuantizationFrame( *it ) ) );
+      if (disk.LeftChildIndex == NullIndex) continue;
 
-   for (int i = 0; i < static_cast<int>(Disks.size()); ++i) {
-      Disks[i].NextIndex = getNextIndex( i );
+      for (int child = disk.LeftChildIndex;; child = Disks[child].NextIndex) {
+         centroid_errors[*it] = std::max( centroid_errors[*it], centroid_errors[child] );
+         if (child == disk.RightChildIndex) break;
+      }
    }
+
+   emitters.resize( Disks.size() );
+   for (int i = 0; i < disk_size; ++i) {
+      Quantizer::getPositionAndArea(
+         emitters[i].CentroidXY, emitters[i].CentroidZAndArea, Disks[i].Centroid, Disks[i].AreaOverPi,
+         getQuantizationFrame( i )
+      );
+      emitters[i].Normal = Quantizer::getOctahedralNormal( Disks[i].Normal );
+      emitters[i].NextIndex = Disks[i].NextIndex;
+      emitters[i].ChildIndex = Disks[i].LeftChildIndex;
+      emitters[i].RadiusAndCone = Quantizer::getRadiusAndCone(
+         Disks[i].Radius + centroid_errors[i], Quantizer::getOctahedralConeSine( Disks[i].ConeSine )
+      );
+   }
+}
+
+OcclusionTree::EmitterForShader OcclusionTree::getEmitterFromQuantized(
+   const QuantizedEmitterForShader& emitter,
+   int index
+) const
+{
+   EmitterForShader decoded;
+   Quantizer::getPositionAndAreaFromQuantized(
+      decoded.Centroid, decoded.AreaOverPi, emitter.CentroidXY, emitter.CentroidZAndArea,
+      getQuantizationFrame( index )
+   );
+   decoded.Normal = emitter.Normal;
+   decoded.NextIndex = emitter.NextIndex;
+   decoded.ChildIndex = emitter.ChildIndex;
+   decoded.RadiusAndCone = emitter.RadiusAndCone;
+   return decoded;
+}
+
+void OcclusionTree::scaleMaxOcclusionDistance(float factor)
+{
+   if (RootIndex == NullIndex) return;
+
+   const float diameter = 2.0f * Disks[RootIndex].Radius;
+   const bool limited = MaxOcclusionDistance < std::numeric_limits<float>::max();
+   const float distance = (limited ? MaxOcclusionDistance : diameter) * factor;
+   MaxOcclusionDistance = distance < diameter ? distance : std::numeric_limits<float>::max();
 }
 
 void OcclusionTree::setBuffer()
 {
    const auto disk_size = static_cast<int>(Disks.size());
-   const auto index_size = static_cast<int>(IndexBuffer.size());
    const auto vertex_size = static_cast<int>(Vertices.size());
-   addCustomBufferObject<Disk>( "in_disks", disk_size );
-   addCustomBufferObject<Disk>( "out_disks", disk_size );
+
+   // the triangles are placed in the order of LeafFaces, so the triangles of a leaf disk are from its FaceBegin.
+   std::vector<GLuint> indices(IndexBuffer.size());
+   for (size_t f = 0; f < LeafFaces.size(); ++f) {
+      std::copy_n( IndexBuffer.begin() + 3 * LeafFaces[f], 3, indices.begin() + 3 * f );
+   }
+   const auto index_size = static_cast<int>(indices.size());
    addCustomBufferObject<int>( "indices", index_size );
+   // the vertices stay 12 bytes each, and the fragment shader reads them as an array of floats.
    addCustomBufferObject<glm::vec3>( "vertices", vertex_size );
-   DisksBuffers[TargetBufferIndex] = getCustomBufferID( "in_disks" );
-   DisksBuffers[TargetBufferIndex ^ 1] = getCustomBufferID( "out_disks" );
    IndicesBuffer = getCustomBufferID( "indices" );
    VerticesBuffer = getCustomBufferID( "vertices" );
-   glNamedBufferSubData(
-      DisksBuffers[0], 0,
-      static_cast<GLsizei>(disk_size * sizeof( Disk )),
-      Disks.data()
-   );
-   glNamedBufferSubData(
-      DisksBuffers[1], 0,
-      static_cast<GLsizei>(disk_size * sizeof( Disk )),
-      Disks.data()
-   );
-    glNamedBufferSubData( IndicesBuffer, 0, index_size, IndexBuffer.data() );
-    glNamedBufferSubData( VerticesBuffer, 0, vertex_size, Vertices.data() );
+   if (Layout == DISK_LAYOUT::HOT_COLD) {
+      std::vector<EmitterForShader> emitters;
+      std::vector<ReceiverForShader> receivers;
+      getHotColdDisks( emitters, receivers );
+      addCustomBufferObject<ReceiverForShader>( "in_receivers", disk_size );
+      addCustomBufferObject<ReceiverForShader>( "out_receivers", disk_size );
+      ReceiversBuffers[TargetBufferIndex] = getCustomBufferID( "in_receivers" );
+      ReceiversBuffers[TargetBufferIndex ^ 1] = getCustomBufferID( "out_receivers" );
+
+      // the faces of the leaves are apart from the emitters, because only the robust occlusion reads them.
+      std::vector<glm::ivec2> face_ranges(disk_size);
+      for (int i = 0; i < disk_size; ++i) face_ranges[i] = glm::ivec2(Disks[i].FaceBegin, Disks[i].FaceCount);
+      addCustomBufferObject<glm::ivec2>( "face_ranges", disk_size );
+      FaceRangesBuffer = getCustomBufferID( "face_ranges" );
+      glNamedBufferSubData(
+         FaceRangesBuffer, 0,
+         static_cast<GLsizei>(disk_size * sizeof( glm::ivec2 )),
+         face_ranges.data()
+      );
+      if (Precision == Quantizer::PRECISION::QUANTIZED) {
+         std::vector<QuantizedEmitterForShader> quantized_emitters;
+         getQuantizedEmitters( quantized_emitters );
+         addCustomBufferObject<QuantizedEmitterForShader>( "emitters", disk_size );
+         EmittersBuffer = getCustomBufferID( "emitters" );
+         glNamedBufferSubData(
+            EmittersBuffer, 0,
+            static_cast<GLsizei>(disk_size * sizeof( QuantizedEmitterForShader )),
+            quantized_emitters.data()
+         );
+
+         const auto frame_size = static_cast<int>(QuantizationFrames.size());
+         addCustomBufferObject<Quantizer::Frame>( "quantization_frames", frame_size );
+         QuantizationFramesBuffer = getCustomBufferID( "quantization_frames" );
+         glNamedBufferSubData(
+            QuantizationFramesBuffer, 0,
+            static_cast<GLsizei>(frame_size * sizeof( Quantizer::Frame )),
+            QuantizationFrames.data()
+         );
+      }
+      else {
+         addCustomBufferObject<EmitterForShader>( "emitters", disk_size );
+         EmittersBuffer = getCustomBufferID( "emitters" );
+         glNamedBufferSubData(
+            EmittersBuffer, 0,
+            static_cast<GLsizei>(disk_size * sizeof( EmitterForShader )),
+            emitters.data()
+         );
+      }
+      for (const auto& buffer : ReceiversBuffers) {
+         glNamedBufferSubData(
+            buffer, 0,
+            static_cast<GLsizei>(disk_size * sizeof( ReceiverForShader )),
+            receivers.data()
+         );
+      }
+   }
+   else {
+      addCustomBufferObject<Disk>( "in_disks", disk_size );
+      addCustomBufferObject<Disk>( "out_disks", disk_size );
+      DisksBuffers[TargetBufferIndex] = getCustomBufferID( "in_disks" );
+      DisksBuffers[TargetBufferIndex ^ 1] = getCustomBufferID( "out_disks" );
+      glNamedBufferSubData(
+         DisksBuffers[0], 0,
+         static_cast<GLsizei>(disk_size * sizeof( Disk )),
+         Disks.data()
+      );
+      glNamedBufferSubData(
+         DisksBuffers[1], 0,
+         static_cast<GLsizei>(disk_size * sizeof( Disk )),
+         Disks.data()
+      );
+   }
+   glNamedBufferSubData( IndicesBuffer, 0, static_cast<GLsizei>(index_size * sizeof( GLuint )), indices.data() );
+   glNamedBufferSubData( VerticesBuffer, 0, static_cast<GLsizei>(vertex_size * sizeof( glm::vec3 )), Vertices.data() );
 }
\ No newline at end of file
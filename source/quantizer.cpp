@@ -0,0 +1,113 @@
+#include "quantizer.h"
+
+Quantizer::Frame Quantizer::getFrame(const glm::vec3& min_point, const glm::vec3& max_point, float max_area)
+{
+   Frame frame;
+   frame.Origin = min_point;
+   frame.Extent = glm::max( max_point - min_point, glm::vec3(0.0f) );
+   frame.AreaScale =
+      max_area > 0.0f && std::isfinite( max_area ) ? std::ldexp( 1.0f, 14 - std::ilogb( max_area ) ) : 1.0f;
+   return frame;
+}
+
+void Quantizer::getPositionAndArea(
+   uint32_t& xy,
+   uint32_t& z_and_area,
+   const glm::vec3& position,
+   float area,
+   const Frame& frame
+)
+{
+   glm::vec3 p(0.0f);
+   for (int i = 0; i < 3; ++i) {
+      if (frame.Extent[i] > 0.0f) p[i] = (position[i] - frame.Origin[i]) / frame.Extent[i];
+   }
+   xy = glm::packUnorm2x16( glm::vec2(p.x, p.y) );
+   z_and_area =
+      (glm::packUnorm2x16( glm::vec2(p.z, 0.0f) ) & 0xffffu) |
+      (glm::packHalf2x16( glm::vec2(0.0f, area * frame.AreaScale) ) & 0xffff0000u);
+}
+
+void Quantizer::getPositionAndAreaFromQuantized(
+   glm::vec3& position,
+   float& area,
+   uint32_t xy,
+   uint32_t z_and_area,
+   const Frame& frame
+)
+{
+   // the same as getPositionAndArea() in the shaders.
+   const glm::vec2 p = glm::unpackUnorm2x16( xy );
+   position = frame.Origin + glm::vec3(p, glm::unpackUnorm2x16( z_and_area ).x) * frame.Extent;
+   area = glm::unpackHalf2x16( z_and_area ).y / frame.AreaScale;
+}
+
+uint32_t Quantizer::getOctahedralNormal(const glm::vec3& normal)
+{
+   const float length = std::abs( normal.x ) + std::abs( normal.y ) + std::abs( normal.z );
+   if (!(length > 0.0f) || std::isinf( length )) return glm::packSnorm2x16( glm::vec2(0.0f) );
+
+   glm::vec2 p = glm::vec2(normal) / length;
+   if (normal.z < 0.0f) {
+      const glm::vec2 sign(p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f);
+      p = (glm::vec2(1.0f) - glm::abs( glm::vec2(p.y, p.x) )) * sign;
+   }
+
+   // the nearest code is not always the closest normal after decoding, so the four codes around p are compared.
+   constexpr float scale = 32767.0f;
+   const glm::vec2 base = glm::floor( p * scale );
+   uint32_t octahedral_normal = 0;
+   float max_cosine = std::numeric_limits<float>::lowest();
+   for (int i = 0; i < 4; ++i) {
+      const glm::vec2 q = glm::clamp( (base + glm::vec2(i & 1, i >> 1)) / scale, glm::vec2(-1.0f), glm::vec2(1.0f) );
+      const uint32_t code = glm::packSnorm2x16( q );
+      const float cosine = glm::dot( getNormalFromOctahedral( code ), normal );
+      if (cosine > max_cosine) {
+         max_cosine = cosine;
+         octahedral_normal = code;
+      }
+   }
+   return octahedral_normal;
+}
+
+glm::vec3 Quantizer::getNormalFromOctahedral(uint32_t octahedral_normal)
+{
+   // the same as getNormal() in the shaders.
+   const glm::vec2 p = glm::unpackSnorm2x16( octahedral_normal );
+   glm::vec3 n(p.x, p.y, 1.0f - std::abs( p.x ) - std::abs( p.y ));
+   const float t = std::max( -n.z, 0.0f );
+   n.x += n.x >= 0.0f ? -t : t;
+   n.y += n.y >= 0.0f ? -t : t;
+   return glm::normalize( n );
+}
+
+float Quantizer::getOctahedralConeSine(float cone_sine)
+{
+   if (!(cone_sine < 1.0f)) return 1.0f;
+
+   const float angle = std::asin( std::max( cone_sine, 0.0f ) ) + 2.0f * OctahedralAngleError;
+   return angle < glm::half_pi<float>() ? std::sin( angle ) : 1.0f;
+}
+
+uint32_t Quantizer::getHalfRoundedUp(float value)
+{
+   uint32_t half = glm::packHalf2x16( glm::vec2(value, 0.0f) ) & 0xffffu;
+   // the next code of a positive half is the next larger value, and the one after the largest finite value is inf.
+   if (glm::unpackHalf2x16( half ).x < value) half++;
+   return half;
+}
+
+uint32_t Quantizer::getRadiusAndCone(float radius, float cone_sine)
+{
+   const uint32_t half_radius = getHalfRoundedUp( std::max( radius, 0.0f ) );
+   const uint32_t half_cone_sine = getHalfRoundedUp( std::clamp( cone_sine, 0.0f, 1.0f ) );
+   return half_radius | (half_cone_sine << 16);
+}
+
+void Quantizer::getRadiusAndConeFromPacked(float& radius, float& cone_sine, uint32_t radius_and_cone)
+{
+   // the same as getRadiusAndCone() in the shaders.
+   const glm::vec2 unpacked = glm::unpackHalf2x16( radius_and_cone );
+   radius = unpacked.x;
+   cone_sine = unpacked.y;
+}
@@ -1,8 +1,8 @@
 #include "renderer.h"
 
 RendererGL::RendererGL() :
-   Window( nullptr ), Pause( false ), UseBentNormal( true ), FrameWidth( 1920 ), FrameHeight( 1080 ),
-   ActiveLightIndex( 0 ), PassNum( 3 ), ClickedPoint( -1, -1 ), Texter( std::make_unique<TextGL>() ),
+   Window( nullptr ), Pause( false ), UseBentNormal( true ), UseNormalCones( true ), FrameWidth( 1920 ),
+   FrameHeight( 1080 ), ActiveLightIndex( 0 ), PassNum( 3 ), ClickedPoint( -1, -1 ), Texter( std::make_unique<TextGL>() ),
    MainCamera( std::make_unique<CameraGL>() ), TextCamera( std::make_unique<CameraGL>() ),
    TextShader( std::make_unique<ShaderGL>() ), Lights( std::make_unique<LightGL>() ), Dynamic(), HighQuality(),
    AlgorithmToCompare( ALGORITHM_TO_COMPARE::DYNAMIC )
@@ -135,6 +135,13 @@ void RendererGL::keyboard(GLFWwindow* window, int key, int scancode, int action,
             else std::cout << ">> Original Normal Used\n";
          }
          break;
+      case GLFW_KEY_N:
+         if (!Renderer->Pause) {
+            Renderer->UseNormalCones = !Renderer->UseNormalCones;
+            if (Renderer->UseNormalCones) std::cout << ">> Normal Cone Culling Used\n";
+            else std::cout << ">> Normal Cone Culling Not Used\n";
+         }
+         break;
       case GLFW_KEY_R:
          if (!Renderer->Pause && Renderer->AlgorithmToCompare == ALGORITHM_TO_COMPARE::HIGH_QUALITY) {
             Renderer->HighQuality.BunnyObject->toggleRobustSwitch();
@@ -161,6 +168,18 @@ void RendererGL::keyboard(GLFWwindow* window, int key, int scancode, int action,
             std::cout << ">> DistanceAttenuation: " << Renderer->HighQuality.BunnyObject->getDistanceAttenuation() << "\n";
          }
          break;
+      case GLFW_KEY_M:
+         if (!Renderer->Pause && Renderer->AlgorithmToCompare == ALGORITHM_TO_COMPARE::HIGH_QUALITY) {
+            if (glfwGetKey( Renderer->Window, GLFW_KEY_LEFT_SHIFT ) != GLFW_PRESS) {
+               Renderer->HighQuality.BunnyObject->scaleMaxOcclusionDistance( 0.5f );
+            }
+            else Renderer->HighQuality.BunnyObject->scaleMaxOcclusionDistance( 2.0f );
+            const float distance = Renderer->HighQuality.BunnyObject->getMaxOcclusionDistance();
+            std::cout << ">> MaxOcclusionDistance: ";
+            if (distance < std::numeric_limits<float>::max()) std::cout << distance << "\n";
+            else std::cout << "Unlimited\n";
+         }
+         break;
       case GLFW_KEY_T:
          if (!Renderer->Pause && Renderer->AlgorithmToCompare == ALGORITHM_TO_COMPARE::HIGH_QUALITY) {
             if (glfwGetKey( Renderer->Window, GLFW_KEY_LEFT_SHIFT ) != GLFW_PRESS) {
@@ -275,7 +294,9 @@ void RendererGL::setHighQualityAmbientOcclusionAlgorithm() const
 
    const std::string sample_directory_path = std::string(CMAKE_SOURCE_DIR) + "/samples";
    const std::string obj_file_path = std::string( sample_directory_path + "/Bunny/bunny.obj");
-   HighQuality.BunnyObject->createOcclusionTree( obj_file_path );
+   HighQuality.BunnyObject->createOcclusionTree(
+      obj_file_path, OcclusionTree::BUILD_METHOD::MEDIAN_SPLIT, OcclusionTree::DISK_LAYOUT::HOT_COLD
+   );
    HighQuality.BunnyObject->setDiffuseReflectionColor( { 1.0f, 1.0f, 1.0f, 1.0f } );
    HighQuality.BunnyObject->setBuffer();
 }
@@ -288,17 +309,21 @@ void RendererGL::calculateDynamicAmbientOcclusion(int pass_num) const
    const int g = getGroupSize( m );
    const ShaderGL* shader = Dynamic.AmbientOcclusionShader.get();
    glUseProgram( shader->getShaderProgram() );
+   const bool quantized = object->getPrecision() == Quantizer::PRECISION::QUANTIZED;
    shader->uniform1i( "Side", m );
    shader->uniform1i( "VertexBufferSize", n );
+   shader->uniform1i( "UseNormalCones", UseNormalCones ? 1 : 0 );
+   shader->uniform1i( "QuantizedLayout", quantized ? 1 : 0 );
+   shader->uniform1f( "SelfSquaredDistance", object->getSelfSquaredDistance() );
    glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 0, object->getReceiversBuffer() );
-   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 1, object->getSurfaceElementsBuffer() );
+   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, quantized ? 2 : 1, object->getSurfaceElementsBuffer() );
+   if (quantized) glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 3, object->getQuantizationFramesBuffer() );
    for (int i = 1; i <= pass_num; ++i) {
       shader->uniform1i( "Phase", i );
       glDispatchCompute( g, g, 1 );
       glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT );
    }
-   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 0, 0 );
-   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 1, 0 );
+   for (GLuint binding = 0; binding <= 3; ++binding) glBindBufferBase( GL_SHADER_STORAGE_BUFFER, binding, 0 );
 }
 
 void RendererGL::drawSceneWithDynamicAmbientOcclusion() const
@@ -322,27 +347,40 @@ void RendererGL::drawSceneWithDynamicAmbientOcclusion() const
 void RendererGL::calculateHighQualityAmbientOcclusion(int pass_num) const
 {
    OcclusionTree* object = HighQuality.BunnyObject.get();
+   const bool hot_cold = object->getLayout() == OcclusionTree::DISK_LAYOUT::HOT_COLD;
+   const bool quantized = hot_cold && object->getPrecision() == Quantizer::PRECISION::QUANTIZED;
    const int n = object->getDiskSize();
    const auto m = static_cast<int>(std::ceil( std::sqrt( static_cast<float>(n) ) ));
    const int g = getGroupSize( m );
    const ShaderGL* shader = HighQuality.AmbientOcclusionShader.get();
    glUseProgram( shader->getShaderProgram() );
+   shader->uniform1i( "HotColdLayout", hot_cold ? 1 : 0 );
+   shader->uniform1i( "QuantizedLayout", quantized ? 1 : 0 );
    shader->uniform1i( "Side", m );
    shader->uniform1i( "DiskSize", n );
    shader->uniform1i( "RootIndex", object->getRootIndex() );
    shader->uniform1f( "ProximityTolerance", object->getProximityTolerance() );
    shader->uniform1f( "DistanceAttenuation", object->getDistanceAttenuation() );
+   shader->uniform1f( "MaxOcclusionDistance", object->getMaxOcclusionDistance() );
+   shader->uniform1i( "UseNormalCones", UseNormalCones ? 1 : 0 );
    for (int i = 1; i <= pass_num - 1; ++i) {
       shader->uniform1i( "FirstPhase", i == 1 ? 1 : 0 );
       shader->uniform1i( "LastPhase", i == pass_num - 1 ? 1 : 0 );
-      glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 0, object->getInDisksBuffer() );
-      glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 1, object->getOutDisksBuffer() );
+      if (hot_cold) {
+         glBindBufferBase( GL_SHADER_STORAGE_BUFFER, quantized ? 5 : 2, object->getEmittersBuffer() );
+         glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 3, object->getInReceiversBuffer() );
+         glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 4, object->getOutReceiversBuffer() );
+         if (quantized) glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 6, object->getQuantizationFramesBuffer() );
+      }
+      else {
+         glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 0, object->getInDisksBuffer() );
+         glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 1, object->getOutDisksBuffer() );
+      }
       glDispatchCompute( g, g, 1 );
       glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT );
       object->swapBuffers();
    }
-   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 0, 0 );
-   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 1, 0 );
+   for (GLuint binding = 0; binding <= 6; ++binding) glBindBufferBase( GL_SHADER_STORAGE_BUFFER, binding, 0 );
 }
 
 void RendererGL::drawSceneWithHighQualityAmbientOcclusion() const
@@ -350,30 +388,40 @@ void RendererGL::drawSceneWithHighQualityAmbientOcclusion() const
    const ShaderGL* shader = HighQuality.SceneShader.get();
    const OcclusionTree* object = HighQuality.BunnyObject.get();
    const bool robust = object->robust();
+   const bool hot_cold = object->getLayout() == OcclusionTree::DISK_LAYOUT::HOT_COLD;
+   const bool quantized = hot_cold && object->getPrecision() == Quantizer::PRECISION::QUANTIZED;
    glViewport( 0, 0, FrameWidth, FrameHeight );
    glBindFramebuffer( GL_FRAMEBUFFER, 0 );
    glUseProgram( shader->getShaderProgram() );
    Lights->transferUniformsToShader( shader );
    shader->uniform1i( "LightIndex", ActiveLightIndex );
+   shader->uniform1i( "HotColdLayout", hot_cold ? 1 : 0 );
+   shader->uniform1i( "QuantizedLayout", quantized ? 1 : 0 );
    shader->uniform1i( "Robust", robust ? 1 : 0 );
    shader->uniform1i( "UseBentNormal", UseBentNormal ? 1 : 0 );
    shader->uniform1i( "RootIndex", object->getRootIndex() );
    shader->uniform1f( "ProximityTolerance", object->getProximityTolerance() );
    shader->uniform1f( "DistanceAttenuation", object->getDistanceAttenuation() );
+   shader->uniform1f( "MaxOcclusionDistance", object->getMaxOcclusionDistance() );
+   shader->uniform1i( "UseNormalCones", UseNormalCones ? 1 : 0 );
    shader->uniform1f( "TriangleAttenuation", object->getTriangleAttenuation() );
    shader->transferBasicTransformationUniforms( glm::mat4(1.0f), MainCamera.get() );
    object->transferUniformsToShader( shader );
-   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 0, object->getInDisksBuffer() );
+   if (hot_cold) {
+      glBindBufferBase( GL_SHADER_STORAGE_BUFFER, quantized ? 5 : 3, object->getEmittersBuffer() );
+      glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 4, object->getInReceiversBuffer() );
+      if (quantized) glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 7, object->getQuantizationFramesBuffer() );
+   }
+   else glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 0, object->getInDisksBuffer() );
    if (robust) {
        glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 1, object->getIndicesBuffer() );
        glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 2, object->getVerticesBuffer() );
+       if (hot_cold) glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 6, object->getFaceRangesBuffer() );
    }
    glBindVertexArray( object->getVAO() );
    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, object->getIBO() );
    glDrawElements( object->getDrawMode(), object->getIndexNum(), GL_UNSIGNED_INT, nullptr );
-   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 0, 0 );
-   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 1, 0 );
-   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 2, 0 );
+   for (GLuint binding = 0; binding <= 7; ++binding) glBindBufferBase( GL_SHADER_STORAGE_BUFFER, binding, 0 );
 }
 
 void RendererGL::drawText(const std::string& text, glm::vec2 start_position) const
@@ -0,0 +1,255 @@
+#include "robust_occlusion_baker.h"
+
+RobustOcclusionBaker::RobustOcclusionBaker(int thread_num) :
+   UseNormalCones( true ), RootIndex( OcclusionTree::NullIndex ), ProximityTolerance( 0.0f ),
+   DistanceAttenuation( 0.0f ), MaxOcclusionDistance( std::numeric_limits<float>::max() ), TriangleAttenuation( 0.0f ),
+   Pool( thread_num )
+{
+}
+
+void RobustOcclusionBaker::setTree(const OcclusionTree& tree, const std::vector<OcclusionTree::Disk>& disks)
+{
+   RootIndex = tree.getRootIndex();
+   ProximityTolerance = tree.getProximityTolerance();
+   DistanceAttenuation = tree.getDistanceAttenuation();
+   MaxOcclusionDistance = tree.getMaxOcclusionDistance();
+   TriangleAttenuation = tree.getTriangleAttenuation();
+   Disks = disks;
+
+   const auto& vertices = tree.getVertices();
+   const auto& indices = tree.getIndices();
+   const auto& leaf_faces = tree.getLeafFaces();
+   Triangles.resize( leaf_faces.size() );
+   for (size_t f = 0; f < leaf_faces.size(); ++f) {
+      const size_t i = 3 * static_cast<size_t>(leaf_faces[f]);
+      Triangles[f] = { vertices[indices[i]], vertices[indices[i + 1]], vertices[indices[i + 2]] };
+   }
+}
+
+void RobustOcclusionBaker::getReceivers(
+   std::vector<SurfaceElement::ReceiverForShader>& receivers,
+   const OcclusionTree& tree
+)
+{
+   const auto& vertices = tree.getVertices();
+   const auto& normals = tree.getNormals();
+   receivers.resize( vertices.size() );
+   for (size_t i = 0; i < vertices.size(); ++i) {
+      receivers[i] = SurfaceElement::ReceiverForShader( vertices[i], normals[i] );
+   }
+}
+
+// the same as isCulledByNormalCone() of the shader, where the disks cast no shadow on the receiver behind them.
+bool RobustOcclusionBaker::isCulledByNormalCone(
+   const OcclusionTree::Disk& emitter,
+   const glm::vec3& v,
+   float squared_distance,
+   const glm::vec3& receiver_normal
+) const
+{
+   return
+      UseNormalCones && OcclusionKernel::isCulledByNormalCone(
+         v, squared_distance, receiver_normal, emitter.Normal, emitter.Radius, emitter.ConeSine
+      );
+}
+
+glm::vec3 RobustOcclusionBaker::getPointOnPlane(
+   const glm::vec3& p0,
+   const glm::vec3& p1,
+   float signed_distance0,
+   float signed_distance1
+)
+{
+   return p0 + (signed_distance0 / (signed_distance0 - signed_distance1)) * (p1 - p0);
+}
+
+void RobustOcclusionBaker::getVisiblePoints(
+   std::array<glm::vec3, 4>& q,
+   const glm::vec3& receiver_position,
+   const glm::vec3& receiver_normal,
+   const std::array<glm::vec3, 3>& triangle
+)
+{
+   const glm::vec3& v0 = triangle[0];
+   const glm::vec3& v1 = triangle[1];
+   const glm::vec3& v2 = triangle[2];
+   const float d = glm::dot( receiver_normal, receiver_position );
+   std::array<float, 3> s{};
+   for (int i = 0; i < 3; ++i) {
+      s[i] = glm::dot( receiver_normal, triangle[i] ) - d;
+      if (std::abs( s[i] ) <= 1e-6f) s[i] = 0.0f;
+   }
+
+   // the cases are named by the signs of the signed distances of v0, v1, and v2, as in the shader.
+   if (s[0] > 0.0f) {
+      if (s[1] > 0.0f) {
+         if (s[2] < 0.0f) q = { v0, v1, getPointOnPlane( v1, v2, s[1], s[2] ), getPointOnPlane( v0, v2, s[0], s[2] ) };
+         else q = { v0, v1, v2, v2 };
+      }
+      else if (s[1] < 0.0f) {
+         if (s[2] > 0.0f) q = { v0, getPointOnPlane( v0, v1, s[0], s[1] ), getPointOnPlane( v2, v1, s[2], s[1] ), v2 };
+         else if (s[2] < 0.0f) {
+            const glm::vec3 q2 = getPointOnPlane( v0, v2, s[0], s[2] );
+            q = { v0, getPointOnPlane( v0, v1, s[0], s[1] ), q2, q2 };
+         }
+         else q = { v0, getPointOnPlane( v0, v1, s[0], s[1] ), v2, v2 };
+      }
+      else {
+         if (s[2] < 0.0f) {
+            const glm::vec3 q2 = getPointOnPlane( v0, v2, s[0], s[2] );
+            q = { v0, v1, q2, q2 };
+         }
+         else q = { v0, v1, v2, v2 };
+      }
+   }
+   else if (s[0] < 0.0f) {
+      if (s[1] > 0.0f) {
+         if (s[2] > 0.0f) q = { getPointOnPlane( v1, v0, s[1], s[0] ), v1, v2, getPointOnPlane( v2, v0, s[2], s[0] ) };
+         else if (s[2] < 0.0f) {
+            const glm::vec3 q2 = getPointOnPlane( v1, v2, s[1], s[2] );
+            q = { getPointOnPlane( v1, v0, s[1], s[0] ), v1, q2, q2 };
+         }
+         else q = { getPointOnPlane( v1, v0, s[1], s[0] ), v1, v2, v2 };
+      }
+      else if (s[1] < 0.0f) {
+         if (s[2] > 0.0f) q = { getPointOnPlane( v2, v0, s[2], s[0] ), getPointOnPlane( v2, v1, s[2], s[1] ), v2, v2 };
+         else q = { receiver_position, receiver_position, receiver_position, receiver_position };
+      }
+      else {
+         if (s[2] > 0.0f) q = { getPointOnPlane( v2, v0, s[2], s[0] ), v1, v2, v2 };
+         else q = { receiver_position, receiver_position, receiver_position, receiver_position };
+      }
+   }
+   else {
+      if (s[1] > 0.0f) {
+         if (s[2] < 0.0f) {
+            const glm::vec3 q2 = getPointOnPlane( v1, v2, s[1], s[2] );
+            q = { v0, v1, q2, q2 };
+         }
+         else q = { v0, v1, v2, v2 };
+      }
+      else if (s[1] < 0.0f) {
+         if (s[2] > 0.0f) q = { v0, getPointOnPlane( v2, v1, s[2], s[1] ), v2, v2 };
+         else q = { receiver_position, receiver_position, receiver_position, receiver_position };
+      }
+      else {
+         if (s[2] > 0.0f) q = { v0, v1, v2, v2 };
+         else q = { receiver_position, receiver_position, receiver_position, receiver_position };
+      }
+   }
+}
+
+float RobustOcclusionBaker::calculateFormFactor(
+   const std::array<glm::vec3, 4>& q,
+   const glm::vec3& receiver_position,
+   const glm::vec3& receiver_normal
+)
+{
+   std::array<glm::vec3, 4> r{};
+   for (int i = 0; i < 4; ++i) r[i] = q[i] - receiver_position;
+
+   // an edge from the receiver itself or between repeated points subtends no angle, so such an edge is skipped as
+   // getEdgeFactor() of the shader skips it.
+   float factor = 0.0f;
+   for (int i = 0; i < 4; ++i) {
+      const glm::vec3& a = r[i];
+      const glm::vec3& b = r[(i + 1) & 3];
+      const float a_length = glm::length( a );
+      const float b_length = glm::length( b );
+      if (!(a_length > 0.0f) || !(b_length > 0.0f)) continue;
+
+      const glm::vec3 ra = a / a_length;
+      const glm::vec3 rb = b / b_length;
+      const glm::vec3 g = glm::cross( rb, ra );
+      const float g_length = glm::length( g );
+      if (!(g_length > 0.0f)) continue;
+
+      factor +=
+         std::acos( std::clamp( glm::dot( ra, rb ), -1.0f, 1.0f ) ) *
+         std::clamp( glm::dot( receiver_normal, g / g_length ), -1.0f, 1.0f );
+   }
+   factor *= glm::one_over_two_pi<float>();
+   return std::max( factor, 0.0f );
+}
+
+void RobustOcclusionBaker::bakeReceiver(SurfaceElement::ReceiverForShader& receiver) const
+{
+   const glm::vec3 receiver_position = receiver.Position;
+   const glm::vec3 receiver_normal = receiver.Normal;
+   glm::vec3 bent_normal = receiver_normal;
+   int parent_next = OcclusionTree::NullIndex;
+   int emitter_index = RootIndex;
+   float total_shadow = 0.0f;
+   float parent_area = 1.0f;
+   float parent_shadow = 0.0f;
+   float parent_weight = 0.0f;
+   while (emitter_index >= 0) {
+      const OcclusionTree::Disk& emitter = Disks[emitter_index];
+      glm::vec3 v = emitter.Centroid - receiver_position;
+      const float squared_distance = glm::dot( v, v ) + 1e-16f;
+      const float reach = MaxOcclusionDistance + emitter.Radius;
+      if (squared_distance > reach * reach) {
+         emitter_index = emitter.NextIndex;
+         if (emitter_index == parent_next) parent_weight = 0.0f;
+         continue;
+      }
+      const float distance = std::sqrt( squared_distance );
+      v /= distance;
+      const float close = ProximityTolerance * emitter.AreaOverPi;
+      if (emitter.LeftChildIndex >= 0 && squared_distance < close * (1.0f + ZoneRadius)) {
+         if (isCulledByNormalCone( emitter, v * distance, squared_distance, receiver_normal )) {
+            emitter_index = emitter.NextIndex;
+            parent_weight = 0.0f;
+            continue;
+         }
+         parent_next = emitter.NextIndex;
+         emitter_index = emitter.LeftChildIndex;
+         float shadow =
+            OcclusionKernel::getDiskShadow( v, squared_distance, receiver_normal, emitter.Normal, emitter.AreaOverPi );
+         shadow *= Disks[emitter_index].Accessibility;
+         shadow /= 1.0f + DistanceAttenuation * distance;
+         parent_shadow = shadow;
+         parent_area = emitter.AreaOverPi;
+         parent_weight = std::clamp(
+            (squared_distance - (1.0f - ZoneRadius) * close) / (2.0f * ZoneRadius * close), 0.0f, 1.0f
+         );
+         continue;
+      }
+
+      float shadow = 0.0f;
+      if (emitter.LeftChildIndex < 0) {
+         if (glm::dot( emitter.Normal, -v ) >= 0.0f) {
+            std::array<glm::vec3, 4> q{};
+            for (int f = emitter.FaceBegin; f < emitter.FaceBegin + emitter.FaceCount; ++f) {
+               getVisiblePoints( q, receiver_position, receiver_normal, Triangles[f] );
+               shadow += calculateFormFactor( q, receiver_position, receiver_normal );
+            }
+            shadow *= std::pow( emitter.Accessibility, TriangleAttenuation );
+            shadow /= 1.0f + DistanceAttenuation * distance;
+         }
+      }
+      else {
+         shadow =
+            OcclusionKernel::getDiskShadow( v, squared_distance, receiver_normal, emitter.Normal, emitter.AreaOverPi );
+         shadow *= emitter.Accessibility;
+         shadow /= 1.0f + DistanceAttenuation * distance;
+      }
+
+      bent_normal -= shadow * v;
+      total_shadow += glm::mix( shadow, parent_shadow * emitter.AreaOverPi / parent_area, parent_weight );
+      emitter_index = emitter.NextIndex;
+      if (emitter_index == parent_next) parent_weight = 0.0f;
+   }
+   receiver.BentNormal = glm::normalize( bent_normal );
+   receiver.Accessibility = std::clamp( 1.0f - total_shadow, 0.0f, 1.0f );
+}
+
+void RobustOcclusionBaker::bake(std::vector<SurfaceElement::ReceiverForShader>& receivers)
+{
+   Pool.runInBlocks(
+      static_cast<int>(receivers.size()), BlockSize, [&](int begin, int end)
+      {
+         for (int i = begin; i < end; ++i) bakeReceiver( receivers[i] );
+      }
+   );
+}
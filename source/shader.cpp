@@ -131,6 +131,9 @@ void ShaderGL::setDynamicAmbientOcclusionUniformLocations()
    addUniformLocation( "Phase" );
    addUniformLocation( "Side" );
    addUniformLocation( "VertexBufferSize" );
+   addUniformLocation( "UseNormalCones" );
+   addUniformLocation( "QuantizedLayout" );
+   addUniformLocation( "SelfSquaredDistance" );
 }
 
 void ShaderGL::setDynamicSceneUniformLocations(int light_num)
@@ -166,6 +169,8 @@ void ShaderGL::setDynamicSceneUniformLocations(int light_num)
 
 void ShaderGL::setHighQualityAmbientOcclusionUniformLocations()
 {
+   addUniformLocation( "HotColdLayout" );
+   addUniformLocation( "QuantizedLayout" );
    addUniformLocation( "FirstPhase" );
    addUniformLocation( "LastPhase" );
    addUniformLocation( "Side" );
@@ -173,6 +178,8 @@ void ShaderGL::setHighQualityAmbientOcclusionUniformLocations()
    addUniformLocation( "RootIndex" );
    addUniformLocation( "ProximityTolerance" );
    addUniformLocation( "DistanceAttenuation" );
+   addUniformLocation( "MaxOcclusionDistance" );
+   addUniformLocation( "UseNormalCones" );
    addUniformLocation( "TriangleAttenuation" );
 }
 
@@ -203,11 +210,15 @@ void ShaderGL::setHighQualitySceneUniformLocations(int light_num)
       Location.Lights[i].LightFallOffRadius = glGetUniformLocation( ShaderProgram, std::string("Lights[" + std::to_string( i ) + "].FallOffRadius").c_str() );
    }
 
+   addUniformLocation( "HotColdLayout" );
+   addUniformLocation( "QuantizedLayout" );
    addUniformLocation( "Robust" );
    addUniformLocation( "UseBentNormal" );
    addUniformLocation( "RootIndex" );
    addUniformLocation( "ProximityTolerance" );
    addUniformLocation( "DistanceAttenuation" );
+   addUniformLocation( "MaxOcclusionDistance" );
+   addUniformLocation( "UseNormalCones" );
    addUniformLocation( "TriangleAttenuation" );
    addUniformLocation( "LightIndex" );
 }
@@ -1,7 +1,9 @@
 #include "surface_element.h"
 
 SurfaceElement::SurfaceElement() :
-   ObjectGL(), IDNum( 0 ), TotalElementSize( 0 ), ReceiversBuffer( 0 ), SurfaceElementsBuffer( 0 )
+   ObjectGL(), IDNum( 0 ), TotalElementSize( 0 ), ElementTree( NullIndex ), BranchingLevels( 1 ),
+   ReceiversBuffer( 0 ), SurfaceElementsBuffer( 0 ), QuantizationFramesBuffer( 0 ),
+   Precision( Quantizer::PRECISION::FULL ), SelfSquaredDistance( 0.0f )
 {
 }
 
@@ -34,8 +36,93 @@ float SurfaceElement::getTriangleArea(const glm::vec3& v0, const glm::vec3& v1,
 #endif
 }
 
+// the angle between the unit vectors u and v, which is also accurate when they are almost parallel.
+float SurfaceElement::getAngle(const glm::vec3& u, const glm::vec3& v)
+{
+   return std::atan2( glm::length( glm::cross( u, v ) ), glm::dot( u, v ) );
+}
+
+// a chart is a connected component of the texture coordinates, and the charts are numbered from 1 in the order of
+// their smallest texture coordinate index. vertex ids are 0 if no face refers to the vertex.
+// a vertex on a seam belongs to several charts, and its id and separator are decided by the order in which the faces
+// are visited. that order used to be a repeated sweep over all faces until nothing changed, which is replayed here
+// with a priority queue keyed by (sweep, face) instead, so that every face is visited only once.
+int SurfaceElement::getChartLabels(
+   std::vector<int>& ids,
+   std::vector<glm::vec2>& separators,
+   size_t vertex_num,
+   const std::vector<glm::vec2>& textures,
+   const std::vector<GLuint>& vertex_indices,
+   const std::vector<GLuint>& texture_indices
+)
+{
+   assert( vertex_indices.size() % 3 == 0 );
+   assert( vertex_indices.size() == texture_indices.size() );
+
+   ids.assign( vertex_num, 0 );
+   separators.assign( vertex_num, glm::vec2(0.0f) );
+
+   // the faces which refer to each texture coordinate, in increasing order.
+   const auto size = static_cast<int>(texture_indices.size());
+   const auto texture_num = static_cast<int>(textures.size());
+   std::vector<int> face_offsets(texture_num + 1, 0);
+   for (const auto t : texture_indices) face_offsets[t + 1]++;
+   std::partial_sum( face_offsets.begin(), face_offsets.end(), face_offsets.begin() );
+   std::vector<int> faces(size);
+   std::vector<int> face_cursors(face_offsets.begin(), face_offsets.end() - 1);
+   for (int i = 0; i < size; ++i) faces[face_cursors[texture_indices[i]]++] = i - i % 3;
+
+   // a face is queued again only if it is reached earlier than before. a visited face has the key 0.
+   constexpr uint64_t unreached = std::numeric_limits<uint64_t>::max();
+   int id = 0;
+   std::vector<int> visit(texture_num, 0);
+   std::vector<uint64_t> face_keys(size / 3, unreached);
+   std::priority_queue<uint64_t, std::vector<uint64_t>, std::greater<>> queue;
+   const auto push_faces = [&](int t, uint64_t sweep, int face)
+   {
+      // a face after the current one is reached in the same sweep, and the others in the next sweep.
+      for (int i = face_offsets[t]; i < face_offsets[t + 1]; ++i) {
+         const int f = faces[i];
+         const uint64_t key = (f > face ? sweep : sweep + 1) << 32 | static_cast<uint64_t>(f);
+         if (key < face_keys[f / 3]) {
+            face_keys[f / 3] = key;
+            queue.push( key );
+         }
+      }
+   };
+   for (int i = 0; i < texture_num; ++i) {
+      if (visit[i] != 0) continue;
+
+      id++;
+      visit[i] = id;
+      push_faces( i, 0, -1 );
+      while (!queue.empty()) {
+         const uint64_t key = queue.top();
+         queue.pop();
+         const auto j = static_cast<int>(key & 0xffffffffull);
+         if (face_keys[j / 3] != key) continue;
+
+         face_keys[j / 3] = 0;
+         const uint64_t sweep = key >> 32;
+         for (int k = 0; k < 3; ++k) {
+            const GLuint t = texture_indices[j + k];
+            const GLuint v = vertex_indices[j + k];
+            if (visit[t] == 0 || ids[v] == 0) {
+               const bool is_new = visit[t] == 0;
+               visit[t] = id;
+               ids[v] = id;
+               separators[v] = textures[t];
+               if (is_new) push_faces( static_cast<int>(t), sweep, j );
+            }
+         }
+      }
+   }
+   return id;
+}
+
 void SurfaceElement::setVertexList(
    const std::vector<glm::vec3>& vertices,
+   const std::vector<glm::vec3>& normals,
    const std::vector<glm::vec2>& textures,
    const std::vector<GLuint>& vertex_indices,
    const std::vector<GLuint>& texture_indices
@@ -43,279 +130,168 @@ void SurfaceElement::setVertexList(
 {
    assert( vertex_indices.size() % 3 == 0 );
    assert( vertex_indices.size() == texture_indices.size() );
+   assert( vertices.size() == normals.size() );
 
    VertexList.clear();
    VertexList.reserve( vertices.size() );
-   for (const auto& v : vertices) VertexList.emplace_back( v );
+   for (size_t i = 0; i < vertices.size(); ++i) {
+      VertexList.emplace_back( vertices[i], normals[i], glm::vec2(0.0f), 0.0f );
+   }
    const auto size = static_cast<int>(vertex_indices.size());
    for (int i = 0; i < size; i += 3) {
       const GLuint v0 = vertex_indices[i];
       const GLuint v1 = vertex_indices[i + 1];
       const GLuint v2 = vertex_indices[i + 2];
       const float area = getTriangleArea( vertices[v0], vertices[v1], vertices[v2] ) / 3.0f;
-      const glm::vec3 normal = glm::cross( vertices[v1] - vertices[v0], vertices[v2] - vertices[v0] );
       VertexList[v0].Area += area;
-      VertexList[v0].Normal += normal;
       VertexList[v1].Area += area;
-      VertexList[v1].Normal += normal;
       VertexList[v2].Area += area;
-      VertexList[v2].Normal += normal;
    }
-   for (auto& v : VertexList) v.Normal = glm::normalize( v.Normal );
 
    // use the texture coordinates to separate vertices and construct hierarchy.
-   int id = 0;
-   std::vector<int> visit(textures.size(), 0);
-   for (int i = 0; i < static_cast<int>(textures.size()); ++i) {
-      if (visit[i] != 0) continue;
-
-      id++;
-      visit[i] = id;
-      bool is_changed = true;
-      while (is_changed) {
-         is_changed = false;
-         for (int j = 0; j < size; j += 3) {
-            if (visit[texture_indices[j]] != id &&
-                visit[texture_indices[j + 1]] != id &&
-                visit[texture_indices[j + 2]] != id) continue;
-
-            for (int k = 0; k < 3; ++k) {
-               if (visit[texture_indices[j + k]] == 0 || VertexList[vertex_indices[j + k]].ID == 0) {
-                  visit[texture_indices[j + k]] = id;
-                  VertexList[vertex_indices[j + k]].ID = id;
-                  VertexList[vertex_indices[j + k]].Separator = textures[texture_indices[j + k]];
-                  is_changed = true;
-               }
-            }
-         }
-      }
+   std::vector<int> ids;
+   std::vector<glm::vec2> separators;
+   IDNum = getChartLabels( ids, separators, vertices.size(), textures, vertex_indices, texture_indices );
+   for (size_t i = 0; i < VertexList.size(); ++i) {
+      VertexList[i].ID = ids[i];
+      VertexList[i].Separator = separators[i];
    }
-   IDNum = id;
 }
 
-bool SurfaceElement::setVertexListFromObjectFile(
-   std::vector<glm::vec3>& vertices,
-   std::vector<glm::vec3>& normals,
-   const std::string& file_path
-)
+bool SurfaceElement::setVertexListFromObjectFile(const std::string& file_path)
 {
-   std::ifstream file(file_path);
-   if (!file.is_open()) {
-      std::cout << "The object file is not correct.\n";
+   ObjectMesh mesh;
+   if (!MeshCache::read( mesh, file_path )) return false;
+   if (!mesh.hasTextures()) {
+      std::cout << "The object file does not have texture coordinates to separate vertices.\n";
       return false;
    }
 
-   std::vector<glm::vec3> vertex_buffer, normal_buffer;
-   std::vector<glm::vec2> texture_buffer;
-   std::vector<GLuint> vertex_indices, normal_indices, texture_indices;
-   while (!file.eof()) {
-      std::string word;
-      file >> word;
-
-      if (word == "v") {
-         glm::vec3 vertex;
-         file >> vertex.x >> vertex.y >> vertex.z;
-         vertex_buffer.emplace_back( vertex );
-      }
-      else if (word == "vt") {
-         glm::vec2 uv;
-         file >> uv.x >> uv.y;
-         texture_buffer.emplace_back( uv );
-      }
-      else if (word == "vn") {
-         glm::vec3 normal;
-         file >> normal.x >> normal.y >> normal.z;
-         normal_buffer.emplace_back( normal );
-      }
-      else if (word == "f") {
-         std::string face;
-         const std::regex delimiter("[/]");
-         for (int i = 0; i < 3; ++i) {
-            file >> face;
-            const std::sregex_token_iterator it(face.begin(), face.end(), delimiter, -1);
-            const std::vector<std::string> vtn(it, std::sregex_token_iterator());
-            vertex_indices.emplace_back( std::stoi( vtn[0] ) - 1 );
-            texture_indices.emplace_back( std::stoi( vtn[1] ) - 1 );
-            normal_indices.emplace_back( std::stoi( vtn[2] ) - 1 );
-         }
-      }
-      else std::getline( file, word );
-   }
-
-   setVertexList( vertex_buffer, texture_buffer, vertex_indices, texture_indices );
+   setVertexList( mesh.Vertices, mesh.VertexNormals, mesh.Textures, mesh.VertexIndices, mesh.TextureIndices );
 
    // render with glDrawElements for efficiency, but some .obj files have the different sizes of vertex and texture
    // coordinates. (which means vertex_buffer.size() != texture_buffer.size())
    // skip the texture setup although the texture coordinates is used as a separator.
-   for (const auto& v : VertexList) {
-      vertices.emplace_back( v.Position );
-      normals.emplace_back( v.Normal );
-   }
-   IndexBuffer = std::move( vertex_indices );
+   Vertices = std::move( mesh.Vertices );
+   Normals = std::move( mesh.VertexNormals );
+   IndexBuffer = std::move( mesh.VertexIndices );
    return true;
 }
 
-std::shared_ptr<SurfaceElement::Element> SurfaceElement::getElementList(int id)
+void SurfaceElement::getChartBuckets(std::vector<int>& offsets, std::vector<int>& vertices) const
 {
-   std::shared_ptr<Element> head, ptr;
-   for (const auto& v : VertexList) {
-      if (v.ID == id) {
-         auto e = std::make_shared<Element>( v.Position, v.Normal, v.Separator, v.Area );
-         if (head == nullptr) head = e;
-         else ptr->Next = e;
-         ptr = e;
-      }
+   // a counting sort by the chart id, which keeps the order of VertexList in each bucket.
+   offsets.assign( IDNum + 2, 0 );
+   for (const auto& v : VertexList) offsets[v.ID + 1]++;
+   std::partial_sum( offsets.begin(), offsets.end(), offsets.begin() );
+   vertices.resize( VertexList.size() );
+   std::vector<int> cursors(offsets.begin(), offsets.end() - 1);
+   for (int i = 0; i < static_cast<int>(VertexList.size()); ++i) vertices[cursors[VertexList[i].ID]++] = i;
+}
+
+void SurfaceElement::setLeafElements(const int* begin, const int* end, int first)
+{
+   for (const int* i = begin; i != end; ++i) {
+      const Vertex& v = VertexList[*i];
+      Elements[first] = Element( v.Position, v.Normal, v.Area );
+      SplitKeys[first] = SplitKey( v.Separator, first );
+      first++;
    }
-   return head;
 }
 
-void SurfaceElement::getBoundary(glm::vec2& min_point, glm::vec2& max_point, std::shared_ptr<Element>& element_list)
+void SurfaceElement::getBoundary(glm::vec2& min_point, glm::vec2& max_point, int begin, int end) const
 {
    min_point = glm::vec2(std::numeric_limits<float>::max());
    max_point = glm::vec2(std::numeric_limits<float>::lowest());
-   for (auto ptr = element_list; ptr != nullptr; ptr = ptr->Next) {
-      if (ptr->Separator.x < min_point.x) min_point.x = ptr->Separator.x;
-      if (ptr->Separator.y < min_point.y) min_point.y = ptr->Separator.y;
+   for (int i = begin; i < end; ++i) {
+      const glm::vec2& separator = SplitKeys[i].Separator;
+      if (separator.x < min_point.x) min_point.x = separator.x;
+      if (separator.y < min_point.y) min_point.y = separator.y;
 
-      if (ptr->Separator.x > max_point.x) max_point.x = ptr->Separator.x;
-      if (ptr->Separator.y > max_point.y) max_point.y = ptr->Separator.y;
+      if (separator.x > max_point.x) max_point.x = separator.x;
+      if (separator.y > max_point.y) max_point.y = separator.y;
    }
 }
 
-float SurfaceElement::getMedian(
-   std::shared_ptr<Element>& element_list,
-   int dimension,
-   int n,
-   float left,
-   float right
-)
-{
-   float median;
-   int count;
-   int iteration = 20;
-   const int h0 = n / 2;
-   const int h1 = n & 1 ? h0 + 1 : h0;
-   do {
-      count = 0;
-      median = (left + right) * 0.5f;
-      for (auto ptr = element_list; ptr != nullptr; ptr = ptr->Next) {
-         if (ptr->Separator[dimension] < median) count++;
-      }
-      if (count < h0) left = median;
-      else right = median;
-   } while (count != h0 && count != h1 && iteration-- > 0);
-   return median;
-}
-
-// create a tree which has child/right subtrees. The original element_list elements will be leaf nodes of this tree.
-std::shared_ptr<SurfaceElement::Element> SurfaceElement::createElementTree(std::shared_ptr<Element>& element_list)
+// split the leaves in [begin, end) into halves along the longer side of their separator boundary, and make the node
+// whose child/right subtrees are the halves. returns where the right half begins.
+int SurfaceElement::splitElements(int begin, int end, int node)
 {
-   if (element_list == nullptr || element_list->Next == nullptr) return element_list;
-
    glm::vec2 min_point, max_point;
-   getBoundary( min_point, max_point, element_list );
-
-   int n = 0;
-   for (auto ptr = element_list; ptr != nullptr; ptr = ptr->Next) n++;
+   getBoundary( min_point, max_point, begin, end );
 
    const int dimension = max_point.x - min_point.x < max_point.y - min_point.y ? 1 : 0;
-   const float median = dimension == 0 ?
-      getMedian( element_list, dimension, n, min_point.x, max_point.x ) :
-      getMedian( element_list, dimension, n, min_point.y, max_point.y );
-
-   std::shared_ptr<Element> left, right;
-   for (auto ptr = element_list; ptr != nullptr;) {
-      std::shared_ptr<Element> next = ptr->Next;
-      if (ptr->Separator[dimension] < median) {
-         ptr->Next = left;
-         left = ptr;
-      }
-      else {
-         ptr->Next = right;
-         right = ptr;
-      }
-      ptr = next;
-   }
-   if (left == nullptr) {
-      left = right;
-      right = right->Next;
-      left->Next = nullptr;
-   }
-   else if (right == nullptr) {
-      right = left;
-      left = left->Next;
-      right->Next = nullptr;
-   }
+   const int middle = begin + (end - begin) / 2;
+   std::nth_element(
+      SplitKeys.begin() + begin, SplitKeys.begin() + middle, SplitKeys.begin() + end,
+      [dimension](const SplitKey& a, const SplitKey& b) { return a.Separator[dimension] < b.Separator[dimension]; }
+   );
 
-   auto root = std::make_shared<Element>();
-   root->Child = createElementTree( left );
-   root->Right = createElementTree( right );
-   return root;
+   Elements[node] = Element();
+   Elements[node].Child = getSubtreeRoot( begin, middle, node + 1 );
+   Elements[node].Right = getSubtreeRoot( middle, end, node + middle - begin );
+   return middle;
 }
 
-// relocate the tree so that it has only child/next nodes.
-void SurfaceElement::relocateElementTree(std::shared_ptr<Element>& element)
+// create a tree which has child/right subtrees. The leaves in [begin, end) will be leaf nodes of this tree.
+// the internal nodes are placed in order from node, and a subtree of n leaves takes n - 1 of them.
+void SurfaceElement::createElementTree(int begin, int end, int node)
 {
-   if (element == nullptr) return;
+   if (end - begin < 2) return;
+
+   const int middle = splitElements( begin, end, node );
+   createElementTree( begin, middle, node + 1 );
+   createElementTree( middle, end, node + middle - begin );
+}
+
+// relocate the tree so that it has only child/next nodes. the children of a node start from its child/right subtrees,
+// and every level of BranchingLevels replaces each internal one of them by its own child/right subtrees.
+void SurfaceElement::relocateElementTree(int element)
+{
+   if (element == NullIndex) return;
 
    int child_num = 0;
-   std::array<std::shared_ptr<Element>, 5> children{};
-   if (element->Child != nullptr) {
-      if (element->Child->Child == nullptr && element->Child->Right == nullptr) {
-         children[child_num] = element->Child;
-         child_num++;
-      }
-      else {
-         if (element->Child->Child != nullptr) {
-            children[child_num] = element->Child->Child;
-            child_num++;
-         }
-         if (element->Child->Right != nullptr) {
-            children[child_num] = element->Child->Right;
-            child_num++;
-         }
-         element->Child = nullptr;
-      }
+   std::array<int, MaxBranchingFactor> children{};
+   for (const int subtree : { Elements[element].Child, Elements[element].Right }) {
+      if (subtree != NullIndex) children[child_num++] = subtree;
    }
-   if (element->Right != nullptr) {
-      if (element->Right->Child == nullptr && element->Right->Right == nullptr) {
-         children[child_num] = element->Right;
-         child_num++;
-      }
-      else {
-         if (element->Right->Child != nullptr) {
-            children[child_num] = element->Right->Child;
-            child_num++;
-         }
-         if (element->Right->Right != nullptr) {
-            children[child_num] = element->Right->Right;
-            child_num++;
+   for (int level = 0; level < BranchingLevels; ++level) {
+      int expanded_num = 0;
+      std::array<int, MaxBranchingFactor> expanded{};
+      for (int i = 0; i < child_num; ++i) {
+         const Element& node = Elements[children[i]];
+         if (node.Child == NullIndex && node.Right == NullIndex) expanded[expanded_num++] = children[i];
+         else {
+            if (node.Child != NullIndex) expanded[expanded_num++] = node.Child;
+            if (node.Right != NullIndex) expanded[expanded_num++] = node.Right;
          }
-         element->Right = nullptr;
       }
+      children = expanded;
+      child_num = expanded_num;
    }
 
    for (int i = 0; i < child_num; ++i) {
-      children[i]->Next = children[i + 1];
+      Elements[children[i]].Next = i + 1 < child_num ? children[i + 1] : NullIndex;
       relocateElementTree( children[i] );
    }
-   element->Child = children[0];
+   Elements[element].Child = child_num > 0 ? children[0] : NullIndex;
+   Elements[element].Right = NullIndex;
 }
 
 // link the last one of a node's children to its next node,
 // so that all the nodes of the tree can be traversed using only child/next nodes.
-void SurfaceElement::linkTree(std::shared_ptr<Element>& element, const std::shared_ptr<Element>& next)
+void SurfaceElement::linkTree(int element, int next)
 {
-   std::shared_ptr<Element> ptr = element;
+   int e = element;
    while (true) {
-      if (ptr->Child != nullptr) {
-         linkTree( ptr->Child, ptr->Next != nullptr ? ptr->Next : next );
+      if (Elements[e].Child != NullIndex) {
+         linkTree( Elements[e].Child, Elements[e].Next != NullIndex ? Elements[e].Next : next );
       }
-      if (ptr->Next == nullptr) {
-         ptr->Next = next;
+      if (Elements[e].Next == NullIndex) {
+         Elements[e].Next = next;
          break;
       }
-      ptr = ptr->Next;
+      e = Elements[e].Next;
    }
 }
 
@@ -323,100 +299,350 @@ void SurfaceElement::linkTree(std::shared_ptr<Element>& element, const std::shar
 // fill the other nodes with information from their children.
 void SurfaceElement::updateAllElements()
 {
-   TotalElementSize = 0;
-   int height = 0;
-   int index = ElementTree == nullptr ? 0 : 1;
-   std::shared_ptr<Element> ptr;
-   for (ptr = ElementTree; ptr != nullptr; ptr = ptr->Child != nullptr ? ptr->Child : ptr->Next) {
-      TotalElementSize++;
-      if (ptr->Child == nullptr) {
-         ptr->Height = height;
-         ptr->Index = index;
-         index++;
+   // the child/next traversal visits every node before its children, so one pass over it in reverse aggregates
+   // the whole tree from the leaves up.
+   std::vector<int> order;
+   for (int e = ElementTree; e != NullIndex; e = getNextElement( e )) order.emplace_back( e );
+   TotalElementSize = static_cast<int>(order.size());
+
+   for (auto it = order.rbegin(); it != order.rend(); ++it) {
+      Element& element = Elements[*it];
+      if (element.Child == NullIndex) continue;
+
+      int child_num = 0;
+      glm::vec3 position(0.0f);
+      glm::vec3 normal(0.0f);
+      float area_sum = 0.0f;
+      for (int next = element.Child; next != element.Next; next = Elements[next].Next) {
+         const Element& child = Elements[next];
+         position += child.Position;
+         normal += child.Normal;
+         area_sum += child.Area;
+         child_num++;
+      }
+      element.Position = position / static_cast<float>(child_num);
+      element.Normal = glm::normalize( normal );
+      element.Area = area_sum;
+
+      // the sphere and the cone of the node hold those of its children.
+      for (int next = element.Child; next != element.Next; next = Elements[next].Next) {
+         const Element& child = Elements[next];
+         const float cone_angle = getAngle( element.Normal, child.Normal ) + child.ConeAngle;
+         element.Radius = std::max( element.Radius, glm::distance( child.Position, element.Position ) + child.Radius );
+         element.ConeAngle = std::isnan( cone_angle ) ?
+            glm::half_pi<float>() : std::max( element.ConeAngle, cone_angle );
       }
    }
 
-   bool done = false;
-   while (!done) {
-      done = true;
-      for (ptr = ElementTree; ptr != nullptr; ptr = ptr->Child != nullptr ? ptr->Child : ptr->Next) {
-         if (ptr->Height >= 0) continue;
-
-         done = false;
-         int child_num = 0;
-         glm::vec3 position(0.0f);
-         glm::vec3 normal(0.0f);
-         float area_sum = 0.0f;
-         std::shared_ptr<Element> next = ptr->Child;
-         while (next != nullptr && next != ptr->Next && next->Height >= 0) {
-            position += next->Position;
-            normal += next->Normal;
-            area_sum += next->Area;
-            next = next->Next;
-            child_num++;
-         }
-         if (next == nullptr || next == ptr->Next) {
-            ptr->Position = position / static_cast<float>(child_num);
-            ptr->Normal = glm::normalize( normal );
-            ptr->Area = area_sum;
-            ptr->Height = height;
-            ptr->Index = ptr == ElementTree ? 0 : index++;
+   // the nodes are numbered group by group from the root, where a group is the children of a node, so that the
+   // siblings which are visited one after another are next to each other. the root is always 0.
+   int index = 0;
+   std::queue<std::pair<int, int>> groups;
+   if (ElementTree != NullIndex) groups.emplace( ElementTree, NullIndex );
+   while (!groups.empty()) {
+      const auto [first, end] = groups.front();
+      groups.pop();
+      for (int e = first; e != end; e = Elements[e].Next) {
+         Elements[e].Index = index++;
+         if (Elements[e].Child != NullIndex) groups.emplace( Elements[e].Child, Elements[e].Next );
+      }
+   }
+}
+
+void SurfaceElement::buildElements()
+{
+   std::vector<int> offsets, vertices;
+   getChartBuckets( offsets, vertices );
+
+   // a chart of n vertices has n leaves and n - 1 internal nodes, so every chart owns a fixed range of Elements
+   // and the charts can be built without sharing anything. the unmapped vertices are placed at the end.
+   std::vector<int> firsts(IDNum + 2, 0);
+   for (int id = 1; id <= IDNum; ++id) {
+      const int n = offsets[id + 1] - offsets[id];
+      firsts[id + 1] = firsts[id] + (n > 0 ? 2 * n - 1 : 0);
+   }
+   const int unmapped_first = firsts[IDNum + 1];
+   Elements.clear();
+   Elements.resize( unmapped_first + offsets[1] );
+   SplitKeys.resize( Elements.size() );
+
+   ThreadPool thread_pool;
+   std::vector<ElementRange> ranges;
+   std::vector<int> roots(IDNum + 1, NullIndex);
+   thread_pool.run(
+      IDNum, [&](int i)
+      {
+         const int id = i + 1;
+         setLeafElements( vertices.data() + offsets[id], vertices.data() + offsets[id + 1], firsts[id] );
+      }
+   );
+   for (int id = 1; id <= IDNum; ++id) {
+      const int n = offsets[id + 1] - offsets[id];
+      if (n == 0) continue;
+
+      roots[id] = getSubtreeRoot( firsts[id], firsts[id] + n, firsts[id] + n );
+      ranges.emplace_back( firsts[id], firsts[id] + n, firsts[id] + n );
+   }
+
+   // the large ranges are split level by level, every range of a level in parallel, until they are small enough
+   // to be built as one task. the node positions do not depend on the order of the tasks.
+   std::vector<ElementRange> tasks;
+   while (!ranges.empty()) {
+      std::vector<ElementRange> large_ranges;
+      for (const auto& range : ranges) {
+         if (range.End - range.Begin > ParallelBuildThreshold) large_ranges.emplace_back( range );
+         else tasks.emplace_back( range );
+      }
+      ranges.resize( large_ranges.size() * 2 );
+      thread_pool.run(
+         static_cast<int>(large_ranges.size()), [&](int i)
+         {
+            const ElementRange& range = large_ranges[i];
+            const int middle = splitElements( range.Begin, range.End, range.Node );
+            ranges[2 * i] = ElementRange( range.Begin, middle, range.Node + 1 );
+            ranges[2 * i + 1] = ElementRange( middle, range.End, range.Node + middle - range.Begin );
          }
+      );
+   }
+   std::stable_sort(
+      tasks.begin(), tasks.end(),
+      [](const ElementRange& a, const ElementRange& b) { return a.End - a.Begin > b.End - b.Begin; }
+   );
+   thread_pool.run(
+      static_cast<int>(tasks.size()), [&](int i) { createElementTree( tasks[i].Begin, tasks[i].End, tasks[i].Node ); }
+   );
+   thread_pool.run( IDNum, [&](int i) { relocateElementTree( roots[i + 1] ); } );
+
+   ElementTree = NullIndex;
+   int last = NullIndex;
+   for (int id = 1; id <= IDNum; ++id) {
+      const int root = roots[id];
+      if (root == NullIndex) continue;
+
+      if (ElementTree == NullIndex) ElementTree = root;
+      else Elements[last].Next = root;
+      last = root;
+   }
+
+   setLeafElements( vertices.data(), vertices.data() + offsets[1], unmapped_first );
+   for (int e = unmapped_first; e < unmapped_first + offsets[1]; ++e) {
+      if (last == NullIndex) ElementTree = e;
+      else Elements[last].Next = e;
+      last = e;
+   }
+
+   if (ElementTree != NullIndex) linkTree( ElementTree, NullIndex );
+   updateAllElements();
+
+   ElementBuffer.clear();
+   ElementBuffer.resize( TotalElementSize );
+   for (int e = ElementTree; e != NullIndex; e = getNextElement( e )) {
+      const Element& element = Elements[e];
+      const int i = element.Index;
+      ElementBuffer[i].Position = element.Position;
+      ElementBuffer[i].Normal = Quantizer::getOctahedralNormal( element.Normal );
+      ElementBuffer[i].AreaOverPi = element.Area / glm::pi<float>();
+      ElementBuffer[i].NextIndex = element.Next != NullIndex ? Elements[element.Next].Index : -1;
+      ElementBuffer[i].ChildIndex = element.Child != NullIndex ? Elements[element.Child].Index : -1;
+      ElementBuffer[i].RadiusAndCone = Quantizer::getRadiusAndCone(
+         element.Radius,
+         Quantizer::getOctahedralConeSine( std::sin( std::min( element.ConeAngle, glm::half_pi<float>() ) ) )
+      );
+   }
+
+   // the tree is not needed once it is flattened into ElementBuffer.
+   ElementTree = NullIndex;
+   Elements = std::vector<Element>();
+   SplitKeys = std::vector<SplitKey>();
+}
+
+uint64_t SurfaceElement::getBuildSettingsHash() const
+{
+   const std::array<uint32_t, 2> settings{ BuilderVersion, static_cast<uint32_t>(BranchingLevels) };
+   return MeshCache::getHash( settings.data(), sizeof( settings ) );
+}
+
+bool SurfaceElement::loadElements(const std::string& cache_file_path, uint64_t source_hash)
+{
+   const MappedFile cache(cache_file_path);
+   if (!cache.isOpen()) return false;
+
+   ElementCacheHeader header;
+   const char* ptr = cache.data();
+   if (!MeshCache::readStruct( header, ptr, cache.end() )) return false;
+   if (header.Magic != ElementCacheHeader().Magic || header.Version != ElementCacheVersion ||
+       header.ElementBytes != sizeof( ElementForShader ) || header.SourceHash != source_hash ||
+       header.SettingsHash != getBuildSettingsHash()) {
+      return false;
+   }
+   const bool loaded =
+      MeshCache::readArray( Vertices, header.VertexNum, ptr, cache.end() ) &&
+      MeshCache::readArray( Normals, header.VertexNum, ptr, cache.end() ) &&
+      MeshCache::readArray( IndexBuffer, header.IndexNum, ptr, cache.end() ) &&
+      MeshCache::readArray( ElementBuffer, header.ElementNum, ptr, cache.end() );
+   if (!loaded) {
+      Vertices.clear();
+      Normals.clear();
+      IndexBuffer.clear();
+      ElementBuffer.clear();
+      return false;
+   }
+   TotalElementSize = static_cast<int>(ElementBuffer.size());
+   return true;
+}
+
+void SurfaceElement::saveElements(const std::string& cache_file_path, uint64_t source_hash) const
+{
+   {
+      std::ofstream file(MeshCache::getTemporaryFilePath( cache_file_path ), std::ios::binary | std::ios::trunc);
+      if (!file.is_open()) return;
+
+      ElementCacheHeader header;
+      header.SourceHash = source_hash;
+      header.SettingsHash = getBuildSettingsHash();
+      header.VertexNum = Vertices.size();
+      header.IndexNum = IndexBuffer.size();
+      header.ElementNum = ElementBuffer.size();
+      MeshCache::writeStruct( file, header );
+      MeshCache::writeArray( file, Vertices );
+      MeshCache::writeArray( file, Normals );
+      MeshCache::writeArray( file, IndexBuffer );
+      MeshCache::writeArray( file, ElementBuffer );
+      if (!file.good()) return;
+   }
+   MeshCache::commitTemporaryFile( cache_file_path );
+}
+
+void SurfaceElement::setQuantizationFrames()
+{
+   // the elements are numbered group by group from the root, so a block is a run of neighboring nodes of one level.
+   const auto element_size = static_cast<int>(ElementBuffer.size());
+   QuantizationFrames.clear();
+   for (int begin = 0; begin < element_size; begin += Quantizer::FrameSize) {
+      glm::vec3 min_point(std::numeric_limits<float>::max());
+      glm::vec3 max_point(std::numeric_limits<float>::lowest());
+      float max_area = 0.0f;
+      for (int i = begin; i < std::min( begin + Quantizer::FrameSize, element_size ); ++i) {
+         min_point = glm::min( min_point, ElementBuffer[i].Position );
+         max_point = glm::max( max_point, ElementBuffer[i].Position );
+         max_area = std::max( max_area, ElementBuffer[i].AreaOverPi );
+      }
+      QuantizationFrames.emplace_back( Quantizer::getFrame( min_point, max_point, max_area ) );
+   }
+
+   SelfSquaredDistance = 0.0f;
+   for (int i = 0; i < element_size; ++i) {
+      if (ElementBuffer[i].ChildIndex >= 0) continue;
+
+      const glm::vec3 cell = Quantizer::getCell( getQuantizationFrame( i ) );
+      SelfSquaredDistance = std::max( SelfSquaredDistance, glm::dot( cell, cell ) );
+   }
+}
+
+void SurfaceElement::getQuantizedElements(std::vector<QuantizedElementForShader>& elements) const
+{
+   // a quantized position is off by up to half a cell of its frame on each axis, and so are the positions of its
+   // subtree. the children of an element come after it, so the largest cell of every subtree is gathered backwards.
+   const auto element_size = static_cast<int>(ElementBuffer.size());
+   std::vector<float> position_errors(element_size);
+   for (int i = element_size - 1; i >= 0; --i) {
+      const ElementForShader& element = ElementBuffer[i];
+      position_errors[i] = glm::length( Quantizer::getCell( getQuantizationFrame( i ) ) );
+      for (int child = element.ChildIndex; child >= 0 && child != element.NextIndex;
+           child = ElementBuffer[child].NextIndex) {
+         position_errors[i] = std::max( position_errors[i], position_errors[child] );
       }
-      height++;
    }
+
+   elements.resize( ElementBuffer.size() );
+   for (int i = 0; i < element_size; ++i) {
+      const ElementForShader& element = ElementBuffer[i];
+      Quantizer::getPositionAndArea(
+         elements[i].PositionXY, elements[i].PositionZAndArea, element.Position, element.AreaOverPi,
+         getQuantizationFrame( i )
+      );
+      elements[i].Normal = element.Normal;
+      elements[i].NextIndex = element.NextIndex;
+      elements[i].ChildIndex = element.ChildIndex;
+
+      float radius, cone_sine;
+      Quantizer::getRadiusAndConeFromPacked( radius, cone_sine, element.RadiusAndCone );
+      elements[i].RadiusAndCone = Quantizer::getRadiusAndCone( radius + position_errors[i], cone_sine );
+   }
+}
+
+SurfaceElement::ElementForShader SurfaceElement::getElementFromQuantized(
+   const QuantizedElementForShader& element,
+   int index
+) const
+{
+   ElementForShader decoded;
+   Quantizer::getPositionAndAreaFromQuantized(
+      decoded.Position, decoded.AreaOverPi, element.PositionXY, element.PositionZAndArea,
+      getQuantizationFrame( index )
+   );
+   decoded.Normal = element.Normal;
+   decoded.NextIndex = element.NextIndex;
+   decoded.ChildIndex = element.ChildIndex;
+   decoded.RadiusAndCone = element.RadiusAndCone;
+   return decoded;
+}
+
+void SurfaceElement::getReceivers(std::vector<ReceiverForShader>& receivers) const
+{
+   receivers.resize( Vertices.size() );
+   for (size_t i = 0; i < Vertices.size(); ++i) receivers[i] = ReceiverForShader( Vertices[i], Normals[i] );
+}
+
+bool SurfaceElement::buildSurfaceElements(const std::string& obj_file_path, bool use_cache, int branching_factor)
+{
+   BranchingLevels = branching_factor >= 4 ? 1 : 0;
+
+   // the source hash comes from the .aomesh header while it is up to date, so a cache hit does not parse the mesh.
+   uint64_t source_hash = 0;
+   if (!MeshCache::getSourceHash( source_hash, obj_file_path )) return false;
+
+   const std::string cache_file_path = MeshCache::getCacheFilePath( obj_file_path, ".aoelem" );
+   if (!use_cache || !loadElements( cache_file_path, source_hash )) {
+      if (!setVertexListFromObjectFile( obj_file_path )) return false;
+      buildElements();
+      if (use_cache) saveElements( cache_file_path, source_hash );
+   }
+   setQuantizationFrames();
+   return true;
 }
 
-void SurfaceElement::createSurfaceElements(const std::string& obj_file_path)
+void SurfaceElement::createSurfaceElements(
+   const std::string& obj_file_path,
+   int branching_factor,
+   Quantizer::PRECISION precision
+)
 {
    DrawMode = GL_TRIANGLES;
-   std::vector<glm::vec3> vertices, normals;
-   if (!setVertexListFromObjectFile( vertices, normals, obj_file_path )) return;
-
-   for (int i = 0; i < static_cast<int>(vertices.size()); ++i) {
-      DataBuffer.emplace_back( vertices[i].x );
-      DataBuffer.emplace_back( vertices[i].y );
-      DataBuffer.emplace_back( vertices[i].z );
-      DataBuffer.emplace_back( normals[i].x );
-      DataBuffer.emplace_back( normals[i].y );
-      DataBuffer.emplace_back( normals[i].z );
-      DataBuffer.emplace_back( normals[i].x ); // for bent normal
-      DataBuffer.emplace_back( normals[i].y ); // for bent normal
-      DataBuffer.emplace_back( normals[i].z ); // for bent normal
+   Precision = precision;
+   if (!buildSurfaceElements( obj_file_path, true, branching_factor )) return;
+
+   for (int i = 0; i < static_cast<int>(Vertices.size()); ++i) {
+      DataBuffer.emplace_back( Vertices[i].x );
+      DataBuffer.emplace_back( Vertices[i].y );
+      DataBuffer.emplace_back( Vertices[i].z );
+      DataBuffer.emplace_back( Normals[i].x );
+      DataBuffer.emplace_back( Normals[i].y );
+      DataBuffer.emplace_back( Normals[i].z );
+      DataBuffer.emplace_back( Normals[i].x ); // for bent normal
+      DataBuffer.emplace_back( Normals[i].y ); // for bent normal
+      DataBuffer.emplace_back( Normals[i].z ); // for bent normal
       DataBuffer.emplace_back( 1.0f ); // for ambient occlusion
       VerticesCount++;
    }
-   vertices.clear();
-   normals.clear();
 
-   const auto n_bytes_per_vertex = static_cast<int>(10 * sizeof( GLfloat ));
+   // a vertex is a ReceiverForShader, which the dynamic shader reads and writes in place.
+   const auto n_bytes_per_vertex = static_cast<int>(sizeof( ReceiverForShader ));
    prepareVertexBuffer( n_bytes_per_vertex );
    prepareNormal();
    prepareBentNormal();
    prepareAccessibility();
    prepareIndexBuffer();
-
-   ElementTree.reset();
-   std::shared_ptr<Element> ptr;
-   for (int i = 0; i < IDNum; ++i) {
-      std::shared_ptr<Element> element_list = getElementList( i + 1 );
-      std::shared_ptr<Element> root = createElementTree( element_list );
-      relocateElementTree( root );
-      if (root == nullptr) continue;
-
-      if (ElementTree == nullptr) ElementTree = root;
-      else ptr->Next = root;
-      ptr = root;
-   }
-
-   std::shared_ptr<Element> unmapped_list = getElementList( 0 );
-   if (unmapped_list != nullptr) {
-      if (ptr == nullptr) ElementTree = unmapped_list;
-      else ptr->Next = unmapped_list;
-   }
-
-   linkTree( ElementTree, nullptr );
-   updateAllElements();
 }
 
 void SurfaceElement::setBuffer()
@@ -424,22 +650,33 @@ void SurfaceElement::setBuffer()
    assert( VBO != 0 );
 
    ReceiversBuffer = VBO;
-   addCustomBufferObject<ElementForShader>( "surface_elements", TotalElementSize );
-   SurfaceElementsBuffer = getCustomBufferID( "surface_elements" );
-
-   ElementBuffer.clear();
-   ElementBuffer.resize( TotalElementSize );
-   for (auto ptr = ElementTree; ptr != nullptr; ptr = ptr->Child != nullptr ? ptr->Child : ptr->Next) {
-      const int i = ptr->Index;
-      ElementBuffer[i].Position = ptr->Position;
-      ElementBuffer[i].Normal = ptr->Normal;
-      ElementBuffer[i].AreaOverPi = ptr->Area / glm::pi<float>();
-      ElementBuffer[i].NextIndex = ptr->Next != nullptr ? ptr->Next->Index : -1;
-      ElementBuffer[i].ChildIndex = ptr->Child != nullptr ? ptr->Child->Index : -1;
+   if (Precision == Quantizer::PRECISION::QUANTIZED) {
+      std::vector<QuantizedElementForShader> elements;
+      getQuantizedElements( elements );
+      addCustomBufferObject<QuantizedElementForShader>( "surface_elements", TotalElementSize );
+      SurfaceElementsBuffer = getCustomBufferID( "surface_elements" );
+      glNamedBufferSubData(
+         SurfaceElementsBuffer, 0,
+         static_cast<GLsizei>(TotalElementSize * sizeof( QuantizedElementForShader )),
+         elements.data()
+      );
+
+      const auto frame_size = static_cast<int>(QuantizationFrames.size());
+      addCustomBufferObject<Quantizer::Frame>( "quantization_frames", frame_size );
+      QuantizationFramesBuffer = getCustomBufferID( "quantization_frames" );
+      glNamedBufferSubData(
+         QuantizationFramesBuffer, 0,
+         static_cast<GLsizei>(frame_size * sizeof( Quantizer::Frame )),
+         QuantizationFrames.data()
+      );
+   }
+   else {
+      addCustomBufferObject<ElementForShader>( "surface_elements", TotalElementSize );
+      SurfaceElementsBuffer = getCustomBufferID( "surface_elements" );
+      glNamedBufferSubData(
+         SurfaceElementsBuffer, 0,
+         static_cast<GLsizei>(TotalElementSize * sizeof( ElementForShader )),
+         ElementBuffer.data()
+      );
    }
-   glNamedBufferSubData(
-      SurfaceElementsBuffer, 0,
-      static_cast<GLsizei>(TotalElementSize * sizeof( ElementForShader )),
-      ElementBuffer.data()
-   );
 }
\ No newline at end of file
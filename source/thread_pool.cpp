@@ -0,0 +1,77 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(int thread_num) :
+   Stop( false ), TaskNum( 0 ), Generation( 0 ), BusyWorkerNum( 0 ), NextTask( 0 ), Function( nullptr )
+{
+   if (thread_num <= 0) thread_num = std::max( static_cast<int>(std::thread::hardware_concurrency()), 1 );
+   Workers.reserve( thread_num - 1 );
+   for (int i = 1; i < thread_num; ++i) Workers.emplace_back( &ThreadPool::work, this );
+}
+
+ThreadPool::~ThreadPool()
+{
+   {
+      std::lock_guard<std::mutex> lock(Mutex);
+      Stop = true;
+   }
+   WorkCondition.notify_all();
+   for (auto& worker : Workers) worker.join();
+}
+
+void ThreadPool::runTasks()
+{
+   for (int i = NextTask++; i < TaskNum; i = NextTask++) (*Function)( i );
+}
+
+void ThreadPool::work()
+{
+   int generation = 0;
+   while (true) {
+      {
+         std::unique_lock<std::mutex> lock(Mutex);
+         WorkCondition.wait( lock, [this, generation]() { return Stop || Generation != generation; } );
+         if (Stop) return;
+         generation = Generation;
+      }
+      runTasks();
+      {
+         std::lock_guard<std::mutex> lock(Mutex);
+         if (--BusyWorkerNum == 0) DoneCondition.notify_one();
+      }
+   }
+}
+
+void ThreadPool::run(int task_num, const std::function<void(int)>& function)
+{
+   if (Workers.empty() || task_num <= 1) {
+      for (int i = 0; i < task_num; ++i) function( i );
+      return;
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(Mutex);
+      Function = &function;
+      TaskNum = task_num;
+      NextTask = 0;
+      BusyWorkerNum = static_cast<int>(Workers.size());
+      Generation++;
+   }
+   WorkCondition.notify_all();
+   runTasks();
+
+   std::unique_lock<std::mutex> lock(Mutex);
+   DoneCondition.wait( lock, [this]() { return BusyWorkerNum == 0; } );
+   Function = nullptr;
+}
+
+void ThreadPool::runInBlocks(int size, int block_size, const std::function<void(int, int)>& function)
+{
+   const int block_num = (size + block_size - 1) / block_size;
+   run(
+      block_num, [size, block_size, &function](int block)
+      {
+         const int begin = block * block_size;
+         function( begin, std::min( begin + block_size, size ) );
+      }
+   );
+}